@@ -0,0 +1,498 @@
+#include "AccessorConversion.hpp"
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ACCESSOR_SSE2
+#include <emmintrin.h>
+// MSVC has no per function target attribute, it stays on the SSE2 baseline
+#if defined(__GNUC__) || defined(__clang__)
+#define ACCESSOR_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ACCESSOR_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+// dst[i] = max(src[i] / divisor, minValue) for n contiguous components of the kernel's source type
+using WidenFn = void (*)(const uint8_t* src, float* dst, size_t n, float divisor, float minValue);
+// dst[i] = src[i] for n contiguous components
+using IndexFn = void (*)(const uint8_t* src, uint32_t* dst, size_t n);
+
+struct Kernels
+{
+    WidenFn u8;
+    WidenFn i8;
+    WidenFn u16;
+    WidenFn i16;
+    IndexFn u8ToU32;
+    IndexFn u16ToU32;
+};
+
+template<typename T>
+void WidenScalar(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        T v;
+        std::memcpy(&v, src + i * sizeof(T), sizeof(T));
+        dst[i] = std::max(static_cast<float>(v) / divisor, minValue);
+    }
+}
+
+template<typename T>
+void IndexScalar(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        T v;
+        std::memcpy(&v, src + i * sizeof(T), sizeof(T));
+        dst[i] = v;
+    }
+}
+
+#ifdef ACCESSOR_SSE2
+// unsigned values can't go below 0 so only the signed kernels clamp
+
+void WidenU8SSE2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 s     = _mm_set1_ps(divisor);
+    size_t i           = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), s));
+        _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), s));
+        _mm_storeu_ps(dst + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), s));
+        _mm_storeu_ps(dst + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), s));
+    }
+    WidenScalar<uint8_t>(src + i, dst + i, n - i, divisor, minValue);
+}
+
+void WidenI8SSE2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m128 s   = _mm_set1_ps(divisor);
+    const __m128 min = _mm_set1_ps(minValue);
+    // duplicating each byte into all 4 bytes of a lane and shifting back arithmetically sign extends it
+    auto convert = [&](__m128i v) { return _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(v, 24)), s), min); };
+    size_t i     = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, v);
+        __m128i hi = _mm_unpackhi_epi8(v, v);
+        _mm_storeu_ps(dst + i, convert(_mm_unpacklo_epi16(lo, lo)));
+        _mm_storeu_ps(dst + i + 4, convert(_mm_unpackhi_epi16(lo, lo)));
+        _mm_storeu_ps(dst + i + 8, convert(_mm_unpacklo_epi16(hi, hi)));
+        _mm_storeu_ps(dst + i + 12, convert(_mm_unpackhi_epi16(hi, hi)));
+    }
+    WidenScalar<int8_t>(src + i, dst + i, n - i, divisor, minValue);
+}
+
+void WidenU16SSE2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 s     = _mm_set1_ps(divisor);
+    size_t i           = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        _mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), s));
+        _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), s));
+    }
+    WidenScalar<uint16_t>(src + i * 2, dst + i, n - i, divisor, minValue);
+}
+
+void WidenI16SSE2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m128 s   = _mm_set1_ps(divisor);
+    const __m128 min = _mm_set1_ps(minValue);
+    size_t i         = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(lo), s), min));
+        _mm_storeu_ps(dst + i + 4, _mm_max_ps(_mm_div_ps(_mm_cvtepi32_ps(hi), s), min));
+    }
+    WidenScalar<int16_t>(src + i * 2, dst + i, n - i, divisor, minValue);
+}
+
+void IndexU8SSE2(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i           = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+    }
+    IndexScalar<uint8_t>(src + i, dst + i, n - i);
+}
+
+void IndexU16SSE2(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i           = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi16(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_unpackhi_epi16(v, zero));
+    }
+    IndexScalar<uint16_t>(src + i * 2, dst + i, n - i);
+}
+#endif
+
+#ifdef ACCESSOR_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET void WidenU8AVX2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m256 s = _mm256_set1_ps(divisor);
+    size_t i       = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), s));
+    }
+    WidenScalar<uint8_t>(src + i, dst + i, n - i, divisor, minValue);
+}
+
+AVX2_TARGET void WidenI8AVX2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m256 s   = _mm256_set1_ps(divisor);
+    const __m256 min = _mm256_set1_ps(minValue);
+    size_t i         = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_div_ps(_mm256_cvtepi32_ps(v), s), min));
+    }
+    WidenScalar<int8_t>(src + i, dst + i, n - i, divisor, minValue);
+}
+
+AVX2_TARGET void WidenU16AVX2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m256 s = _mm256_set1_ps(divisor);
+    size_t i       = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2)));
+        _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), s));
+    }
+    WidenScalar<uint16_t>(src + i * 2, dst + i, n - i, divisor, minValue);
+}
+
+AVX2_TARGET void WidenI16AVX2(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const __m256 s   = _mm256_set1_ps(divisor);
+    const __m256 min = _mm256_set1_ps(minValue);
+    size_t i         = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2)));
+        _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_div_ps(_mm256_cvtepi32_ps(v), s), min));
+    }
+    WidenScalar<int16_t>(src + i * 2, dst + i, n - i, divisor, minValue);
+}
+
+AVX2_TARGET void IndexU8AVX2(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i))));
+    IndexScalar<uint8_t>(src + i, dst + i, n - i);
+}
+
+AVX2_TARGET void IndexU16AVX2(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2))));
+    IndexScalar<uint16_t>(src + i * 2, dst + i, n - i);
+}
+#endif
+
+#ifdef ACCESSOR_NEON
+void WidenU16x8NEON(uint16x8_t v, float* dst, float32x4_t s)
+{
+    vst1q_f32(dst, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), s));
+    vst1q_f32(dst + 4, vdivq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), s));
+}
+
+void WidenI16x8NEON(int16x8_t v, float* dst, float32x4_t s, float32x4_t min)
+{
+    vst1q_f32(dst, vmaxq_f32(vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), s), min));
+    vst1q_f32(dst + 4, vmaxq_f32(vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), s), min));
+}
+
+void WidenU8NEON(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const float32x4_t s = vdupq_n_f32(divisor);
+    size_t i            = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(src + i);
+        WidenU16x8NEON(vmovl_u8(vget_low_u8(v)), dst + i, s);
+        WidenU16x8NEON(vmovl_u8(vget_high_u8(v)), dst + i + 8, s);
+    }
+    WidenScalar<uint8_t>(src + i, dst + i, n - i, divisor, minValue);
+}
+
+void WidenI8NEON(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const float32x4_t s   = vdupq_n_f32(divisor);
+    const float32x4_t min = vdupq_n_f32(minValue);
+    size_t i              = 0;
+    for(; i + 16 <= n; i += 16)
+    {
+        int8x16_t v = vld1q_s8(reinterpret_cast<const int8_t*>(src + i));
+        WidenI16x8NEON(vmovl_s8(vget_low_s8(v)), dst + i, s, min);
+        WidenI16x8NEON(vmovl_s8(vget_high_s8(v)), dst + i + 8, s, min);
+    }
+    WidenScalar<int8_t>(src + i, dst + i, n - i, divisor, minValue);
+}
+
+void WidenU16NEON(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const float32x4_t s = vdupq_n_f32(divisor);
+    size_t i            = 0;
+    for(; i + 8 <= n; i += 8)
+        WidenU16x8NEON(vreinterpretq_u16_u8(vld1q_u8(src + i * 2)), dst + i, s);
+    WidenScalar<uint16_t>(src + i * 2, dst + i, n - i, divisor, minValue);
+}
+
+void WidenI16NEON(const uint8_t* src, float* dst, size_t n, float divisor, float minValue)
+{
+    const float32x4_t s   = vdupq_n_f32(divisor);
+    const float32x4_t min = vdupq_n_f32(minValue);
+    size_t i              = 0;
+    for(; i + 8 <= n; i += 8)
+        WidenI16x8NEON(vreinterpretq_s16_u8(vld1q_u8(src + i * 2)), dst + i, s, min);
+    WidenScalar<int16_t>(src + i * 2, dst + i, n - i, divisor, minValue);
+}
+
+void IndexU8NEON(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        uint16x8_t v = vmovl_u8(vld1_u8(src + i));
+        vst1q_u32(dst + i, vmovl_u16(vget_low_u16(v)));
+        vst1q_u32(dst + i + 4, vmovl_u16(vget_high_u16(v)));
+    }
+    IndexScalar<uint8_t>(src + i, dst + i, n - i);
+}
+
+void IndexU16NEON(const uint8_t* src, uint32_t* dst, size_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8)
+    {
+        uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src + i * 2));
+        vst1q_u32(dst + i, vmovl_u16(vget_low_u16(v)));
+        vst1q_u32(dst + i + 4, vmovl_u16(vget_high_u16(v)));
+    }
+    IndexScalar<uint16_t>(src + i * 2, dst + i, n - i);
+}
+#endif
+
+Kernels SelectKernels()
+{
+#if defined(ACCESSOR_AVX2)
+    if(__builtin_cpu_supports("avx2"))
+        return {WidenU8AVX2, WidenI8AVX2, WidenU16AVX2, WidenI16AVX2, IndexU8AVX2, IndexU16AVX2};
+#endif
+#if defined(ACCESSOR_SSE2)
+    return {WidenU8SSE2, WidenI8SSE2, WidenU16SSE2, WidenI16SSE2, IndexU8SSE2, IndexU16SSE2};
+#elif defined(ACCESSOR_NEON)
+    return {WidenU8NEON, WidenI8NEON, WidenU16NEON, WidenI16NEON, IndexU8NEON, IndexU16NEON};
+#else
+    return {WidenScalar<uint8_t>, WidenScalar<int8_t>, WidenScalar<uint16_t>, WidenScalar<int16_t>, IndexScalar<uint8_t>, IndexScalar<uint16_t>};
+#endif
+}
+
+const Kernels& GetKernels()
+{
+    static const Kernels kernels = SelectKernels();
+    return kernels;
+}
+
+size_t ComponentSize(int componentType)
+{
+    switch(componentType)
+    {
+    case AccessorView::BYTE:
+    case AccessorView::UNSIGNED_BYTE:
+        return 1;
+    case AccessorView::SHORT:
+    case AccessorView::UNSIGNED_SHORT:
+        return 2;
+    case AccessorView::UNSIGNED_INT:
+    case AccessorView::FLOAT:
+        return 4;
+    default:
+        throw std::runtime_error(std::format("unsupported accessor component type {}", componentType));
+    }
+}
+
+void ConvertUInt32ToFloat(const AccessorView& src, uint8_t* dst, size_t dstStride)
+{
+    for(size_t i = 0; i < src.count; ++i)
+    {
+        for(uint32_t c = 0; c < src.componentCount; ++c)
+        {
+            uint32_t v;
+            std::memcpy(&v, src.data + i * src.stride + c * sizeof(uint32_t), sizeof(uint32_t));
+            const float f = static_cast<float>(v);
+            std::memcpy(dst + i * dstStride + c * sizeof(float), &f, sizeof(float));
+        }
+    }
+}
+}
+
+void ConvertToFloat(const AccessorView& src, uint8_t* dst, size_t dstStride)
+{
+    const size_t componentSize = ComponentSize(src.componentType);
+    const size_t elementSize   = componentSize * src.componentCount;
+    if(src.componentCount == 0 || src.componentCount > 4)
+        throw std::runtime_error(std::format("unsupported accessor component count {}", src.componentCount));
+    if(src.count == 0)
+        return;
+
+    if(src.componentType == AccessorView::FLOAT)
+    {
+        if(src.stride == elementSize && dstStride == elementSize)
+        {
+            std::memcpy(dst, src.data, src.count * elementSize);
+            return;
+        }
+        for(size_t i = 0; i < src.count; ++i)
+            std::memcpy(dst + i * dstStride, src.data + i * src.stride, elementSize);
+        return;
+    }
+    if(src.componentType == AccessorView::UNSIGNED_INT)
+    {
+        if(src.normalized)
+            throw std::runtime_error("normalized unsigned int accessors aren't allowed");
+        ConvertUInt32ToFloat(src, dst, dstStride);
+        return;
+    }
+
+    // glTF normalization: unsigned c / max, signed max(c / max, -1). Divided rather than multiplied by the reciprocal so the
+    // result is exactly what the spec formula gives
+    const Kernels& kernels = GetKernels();
+    WidenFn widen          = nullptr;
+    float divisor          = 1.0f;
+    float minValue         = std::numeric_limits<float>::lowest();
+    switch(src.componentType)
+    {
+    case AccessorView::UNSIGNED_BYTE:
+        widen   = kernels.u8;
+        divisor = src.normalized ? 255.0f : 1.0f;
+        break;
+    case AccessorView::BYTE:
+        widen   = kernels.i8;
+        divisor = src.normalized ? 127.0f : 1.0f;
+        break;
+    case AccessorView::UNSIGNED_SHORT:
+        widen   = kernels.u16;
+        divisor = src.normalized ? 65535.0f : 1.0f;
+        break;
+    case AccessorView::SHORT:
+        widen   = kernels.i16;
+        divisor = src.normalized ? 32767.0f : 1.0f;
+        break;
+    }
+    if(src.normalized)
+        minValue = -1.0f;
+
+    // converted in blocks that fit on the stack: gather the elements if they aren't packed, widen the block, scatter it into dst
+    constexpr size_t BLOCK_ELEMENTS = 256;
+    alignas(16) uint8_t gathered[BLOCK_ELEMENTS * 4 * sizeof(uint16_t)];
+    alignas(16) float converted[BLOCK_ELEMENTS * 4];
+    const bool packed = src.stride == elementSize;
+
+    for(size_t first = 0; first < src.count; first += BLOCK_ELEMENTS)
+    {
+        const size_t count    = std::min(BLOCK_ELEMENTS, src.count - first);
+        const uint8_t* source = src.data + first * src.stride;
+        if(!packed)
+        {
+            for(size_t i = 0; i < count; ++i)
+                std::memcpy(gathered + i * elementSize, source + i * src.stride, elementSize);
+            source = gathered;
+        }
+
+        widen(source, converted, count * src.componentCount, divisor, minValue);
+
+        for(size_t i = 0; i < count; ++i)
+            std::memcpy(dst + (first + i) * dstStride, converted + i * src.componentCount, src.componentCount * sizeof(float));
+    }
+}
+
+void ConvertToUInt32(const AccessorView& src, uint32_t* dst)
+{
+    if(src.componentCount != 1)
+        throw std::runtime_error("index accessor type must be scalar");
+    if(src.count == 0)
+        return;
+
+    const size_t componentSize = ComponentSize(src.componentType);
+    const bool packed          = src.stride == componentSize;
+    const Kernels& kernels     = GetKernels();
+    switch(src.componentType)
+    {
+    case AccessorView::UNSIGNED_INT:
+        if(packed)
+        {
+            std::memcpy(dst, src.data, src.count * sizeof(uint32_t));
+        }
+        else
+        {
+            for(size_t i = 0; i < src.count; ++i)
+                std::memcpy(dst + i, src.data + i * src.stride, sizeof(uint32_t));
+        }
+        break;
+    case AccessorView::UNSIGNED_SHORT:
+        if(packed)
+        {
+            kernels.u16ToU32(src.data, dst, src.count);
+        }
+        else
+        {
+            for(size_t i = 0; i < src.count; ++i)
+                IndexScalar<uint16_t>(src.data + i * src.stride, dst + i, 1);
+        }
+        break;
+    case AccessorView::UNSIGNED_BYTE:
+        if(packed)
+        {
+            kernels.u8ToU32(src.data, dst, src.count);
+        }
+        else
+        {
+            for(size_t i = 0; i < src.count; ++i)
+                IndexScalar<uint8_t>(src.data + i * src.stride, dst + i, 1);
+        }
+        break;
+    default:
+        throw std::runtime_error("unsupported index component type");
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw description of a glTF accessor's elements, independent of the glTF loader
+struct AccessorView
+{
+    // glTF componentType values
+    enum ComponentType : int
+    {
+        BYTE           = 5120,
+        UNSIGNED_BYTE  = 5121,
+        SHORT          = 5122,
+        UNSIGNED_SHORT = 5123,
+        UNSIGNED_INT   = 5125,
+        FLOAT          = 5126,
+    };
+
+    const uint8_t* data;
+    size_t count;   // number of elements
+    size_t stride;  // bytes from one element to the next
+    int componentType;
+    uint32_t componentCount;
+    bool normalized;
+};
+
+// Writes the elements of src as floats to dst, element i starting at dst + i * dstStride, so the result can go straight into an
+// interleaved vertex. The kernel is picked once per call: float data is copied as is, integer data gets widened with SSE2/AVX2
+// or NEON (normalized per the glTF spec). Strided sources are gathered in small blocks first.
+// Throws std::runtime_error for types that can't be converted
+void ConvertToFloat(const AccessorView& src, uint8_t* dst, size_t dstStride);
+
+// Writes the elements of a scalar unsigned accessor (indices) to dst as a tightly packed uint32 array
+void ConvertToUInt32(const AccessorView& src, uint32_t* dst);
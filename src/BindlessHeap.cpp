@@ -0,0 +1,169 @@
+#include "BindlessHeap.hpp"
+#include "Renderer.hpp"
+#include "Log.hpp"
+#include <algorithm>
+
+namespace
+{
+// upper bounds, the actual sizes get clamped to what the device supports
+constexpr uint32_t MAX_SAMPLED_IMAGES          = 16384;
+constexpr uint32_t MAX_STORAGE_IMAGES          = 4096;
+constexpr uint32_t MAX_STORAGE_BUFFERS         = 16384;
+constexpr uint32_t MAX_ACCELERATION_STRUCTURES = 64;
+}
+
+BindlessHeap::BindlessHeap(Renderer& renderer) : m_renderer(renderer)
+{
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
+    accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+    VkPhysicalDeviceVulkan12Properties properties12{};
+    properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    properties12.pNext = &accelerationStructureProperties;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(VulkanContext::GetPhysicalDevice(), &properties2);
+
+    // the set is visible to every stage so the per stage limits are the ones that matter
+    m_allocators[SAMPLED_IMAGE].capacity          = std::min({MAX_SAMPLED_IMAGES, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSamplers});
+    m_allocators[STORAGE_IMAGE].capacity          = std::min(MAX_STORAGE_IMAGES, properties12.maxPerStageDescriptorUpdateAfterBindStorageImages);
+    m_allocators[STORAGE_BUFFER].capacity         = std::min(MAX_STORAGE_BUFFERS, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+    m_allocators[ACCELERATION_STRUCTURE].capacity = std::min(MAX_ACCELERATION_STRUCTURES, accelerationStructureProperties.maxPerStageDescriptorUpdateAfterBindAccelerationStructures);
+
+    DescriptorSetLayoutBuilder builder;
+    std::array<VkDescriptorPoolSize, BINDING_COUNT> poolSizes{};
+    for(uint32_t i = 0; i < BINDING_COUNT; i++)
+    {
+        builder.AddBinding(i, s_types[i], m_allocators[i].capacity);
+        poolSizes[i].type            = s_types[i];
+        poolSizes[i].descriptorCount = m_allocators[i].capacity;
+    }
+    m_layout = builder.Build(VK_SHADER_STAGE_ALL);
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.poolSizeCount              = static_cast<uint32_t>(poolSizes.size());
+    poolCreateInfo.pPoolSizes                 = poolSizes.data();
+    poolCreateInfo.maxSets                    = 1;
+    poolCreateInfo.flags                      = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    VK_CHECK(vkCreateDescriptorPool(VulkanContext::GetDevice(), &poolCreateInfo, nullptr, &m_pool), "Failed to create bindless descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool     = m_pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts        = &m_layout;
+    VK_CHECK(vkAllocateDescriptorSets(VulkanContext::GetDevice(), &allocInfo, &m_set), "Failed to allocate bindless descriptor set");
+
+    VK_SET_DEBUG_NAME(m_layout, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, "dsl_bindless");
+    VK_SET_DEBUG_NAME(m_set, VK_OBJECT_TYPE_DESCRIPTOR_SET, "ds_bindless");
+
+    Log::Info("Bindless heap: {} sampled images, {} storage images, {} storage buffers, {} acceleration structures",
+              m_allocators[SAMPLED_IMAGE].capacity,
+              m_allocators[STORAGE_IMAGE].capacity,
+              m_allocators[STORAGE_BUFFER].capacity,
+              m_allocators[ACCELERATION_STRUCTURE].capacity);
+}
+
+BindlessHeap::~BindlessHeap()
+{
+    vkDestroyDescriptorPool(VulkanContext::GetDevice(), m_pool, nullptr);
+    vkDestroyDescriptorSetLayout(VulkanContext::GetDevice(), m_layout, nullptr);
+}
+
+uint32_t BindlessHeap::RegisterSampledImage(VkImageView view, VkImageLayout layout, SamplerConfig sampler)
+{
+    DescriptorInfo info{};
+    info.image.imageView   = view;
+    info.image.imageLayout = layout;
+    info.image.sampler     = m_renderer.GetSampler(sampler);
+    return Register(SAMPLED_IMAGE, info);
+}
+
+uint32_t BindlessHeap::RegisterStorageImage(VkImageView view)
+{
+    DescriptorInfo info{};
+    info.image.imageView   = view;
+    info.image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    return Register(STORAGE_IMAGE, info);
+}
+
+uint32_t BindlessHeap::RegisterStorageBuffer(VkBuffer buffer)
+{
+    DescriptorInfo info{};
+    info.buffer.buffer = buffer;
+    info.buffer.offset = 0;
+    info.buffer.range  = VK_WHOLE_SIZE;
+    return Register(STORAGE_BUFFER, info);
+}
+
+uint32_t BindlessHeap::RegisterAccelerationStructure(VkAccelerationStructureKHR accelerationStructure)
+{
+    DescriptorInfo info{};
+    info.accelerationStructure = accelerationStructure;
+    return Register(ACCELERATION_STRUCTURE, info);
+}
+
+void BindlessHeap::UpdateSampledImage(uint32_t index, VkImageView view, VkImageLayout layout, SamplerConfig sampler)
+{
+    if(index == INVALID_INDEX)
+        return;
+
+    DescriptorInfo info{};
+    info.image.imageView   = view;
+    info.image.imageLayout = layout;
+    info.image.sampler     = m_renderer.GetSampler(sampler);
+
+    std::scoped_lock lock(m_mutex);
+    m_writer.Write(m_set, SAMPLED_IMAGE, index, s_types[SAMPLED_IMAGE], info);
+}
+
+void BindlessHeap::Release(Binding binding, uint32_t index)
+{
+    if(index == INVALID_INDEX)
+        return;
+
+    std::scoped_lock lock(m_mutex);
+    m_writer.Discard(m_set, binding, index);
+    m_released[m_frameIndex].emplace_back(binding, index);
+}
+
+void BindlessHeap::BeginFrame(uint32_t frameIndex)
+{
+    std::scoped_lock lock(m_mutex);
+    m_frameIndex = frameIndex;
+    for(auto [binding, index] : m_released[frameIndex])
+        m_allocators[binding].freeIndices.push_back(index);
+    m_released[frameIndex].clear();
+}
+
+void BindlessHeap::Flush()
+{
+    std::scoped_lock lock(m_mutex);
+    m_writer.Flush();
+}
+
+uint32_t BindlessHeap::Register(Binding binding, const DescriptorInfo& info)
+{
+    std::scoped_lock lock(m_mutex);
+    uint32_t index = Allocate(binding);
+    if(index != INVALID_INDEX)
+        m_writer.Write(m_set, binding, index, s_types[binding], info);
+    return index;
+}
+
+uint32_t BindlessHeap::Allocate(Binding binding)
+{
+    auto& allocator = m_allocators[binding];
+    if(!allocator.freeIndices.empty())
+    {
+        uint32_t index = allocator.freeIndices.back();
+        allocator.freeIndices.pop_back();
+        return index;
+    }
+    if(allocator.next < allocator.capacity)
+        return allocator.next++;
+
+    Log::Error("Bindless heap is out of {} descriptors (capacity {})", string_VkDescriptorType(s_types[binding]), allocator.capacity);
+    return INVALID_INDEX;
+}
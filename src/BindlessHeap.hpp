@@ -0,0 +1,92 @@
+#pragma once
+
+#include "DescriptorSet.hpp"
+#include "Sampler.hpp"
+#include "VulkanContext.hpp"
+#include <array>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+class Renderer;
+
+// One big update after bind descriptor set that every sampled image, storage image, storage buffer and TLAS gets registered in
+// when it is created. The index handed out stays valid for the lifetime of the resource so shaders can index the heap directly:
+//      [[vk::binding(0, 3)]] Sampler2D textures[];
+//      [[vk::binding(1, 3)]] RWTexture2D<float4> storageImages[];
+//      [[vk::binding(2, 3)]] RWByteAddressBuffer buffers[];
+//      [[vk::binding(3, 3)]] RaytracingAccelerationStructure accelerationStructures[];
+// Pipelines whose shaders use set BindlessHeap::SET get the heap's set bound there instead of allocating their own
+class BindlessHeap
+{
+public:
+    static constexpr uint32_t SET           = 3;
+    static constexpr uint32_t INVALID_INDEX = std::numeric_limits<uint32_t>::max();
+
+    enum Binding : uint32_t
+    {
+        SAMPLED_IMAGE = 0,
+        STORAGE_IMAGE,
+        STORAGE_BUFFER,
+        ACCELERATION_STRUCTURE,
+
+        BINDING_COUNT
+    };
+
+    BindlessHeap(Renderer& renderer);
+    ~BindlessHeap();
+
+    BindlessHeap(const BindlessHeap& other)            = delete;
+    BindlessHeap& operator=(const BindlessHeap& other) = delete;
+
+    uint32_t RegisterSampledImage(VkImageView view, VkImageLayout layout, SamplerConfig sampler);
+    uint32_t RegisterStorageImage(VkImageView view);
+    uint32_t RegisterStorageBuffer(VkBuffer buffer);
+    uint32_t RegisterAccelerationStructure(VkAccelerationStructureKHR accelerationStructure);
+
+    void UpdateSampledImage(uint32_t index, VkImageView view, VkImageLayout layout, SamplerConfig sampler);
+
+    // the index only gets handed out again once every frame that could still be using it has finished
+    void Release(Binding binding, uint32_t index);
+
+    // called by the renderer once the fence of frameIndex has been waited on
+    void BeginFrame(uint32_t frameIndex);
+    // writes are only applied here, CommandBuffer calls it before every submit
+    void Flush();
+
+    [[nodiscard]] VkDescriptorSetLayout GetLayout() const { return m_layout; }
+    [[nodiscard]] VkDescriptorSet GetSet() const { return m_set; }
+    [[nodiscard]] static VkDescriptorType GetDescriptorType(Binding binding) { return s_types[binding]; }
+
+private:
+    struct IndexAllocator
+    {
+        uint32_t capacity = 0;
+        uint32_t next     = 0;
+        std::vector<uint32_t> freeIndices;
+    };
+
+    uint32_t Register(Binding binding, const DescriptorInfo& info);
+    uint32_t Allocate(Binding binding);
+
+    static constexpr std::array<VkDescriptorType, BINDING_COUNT> s_types = {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+    };
+
+    Renderer& m_renderer;
+
+    VkDescriptorPool m_pool        = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+    VkDescriptorSet m_set          = VK_NULL_HANDLE;
+
+    std::mutex m_mutex;
+    DescriptorWriter m_writer;
+    std::array<IndexAllocator, BINDING_COUNT> m_allocators;
+
+    // indices released while recording a frame, they are recycled when that frame slot comes around again
+    std::array<std::vector<std::pair<Binding, uint32_t>>, NUM_FRAMES_IN_FLIGHT> m_released;
+    uint32_t m_frameIndex = 0;
+};
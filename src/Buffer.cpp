@@ -1,4 +1,5 @@
 #include "Buffer.hpp"
+#include <algorithm>
 #include <cstring>
 #include "Log.hpp"
 
@@ -18,6 +19,10 @@ void Buffer::Free()
 {
     if(m_buffer != VK_NULL_HANDLE)
     {
+        if(BindlessHeap* heap = VulkanContext::GetBindlessHeap())
+            heap->Release(BindlessHeap::STORAGE_BUFFER, m_bindlessIndex);
+        m_bindlessIndex = BindlessHeap::INVALID_INDEX;
+
         vmaDestroyBuffer(VulkanContext::GetVmaAllocator(), m_buffer, m_allocation);
         m_buffer = VK_NULL_HANDLE;
     }
@@ -46,6 +51,10 @@ void Buffer::Allocate(VkDeviceSize size, VkBufferUsageFlags usage, bool mappable
     if(usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
         m_type = Buffer::Type::UNIFORM;
 
+    // descriptor buffers reference uniform and storage buffers by address
+    if(VulkanContext::GetDescriptorBuffer() && (usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)))
+        usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
     VkBufferCreateInfo createInfo = {};
     createInfo.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     createInfo.size               = size;
@@ -70,6 +79,10 @@ void Buffer::Allocate(VkDeviceSize size, VkBufferUsageFlags usage, bool mappable
     m_mappedMemory = allocInfo.pMappedData;
     VkMemoryPropertyFlags memPropFlags;
     vmaGetAllocationMemoryProperties(VulkanContext::GetVmaAllocator(), m_allocation, &memPropFlags);
+
+    BindlessHeap* heap = VulkanContext::GetBindlessHeap();
+    if(heap && (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+        m_bindlessIndex = heap->RegisterStorageBuffer(m_buffer);
 }
 
 void Buffer::Copy(Buffer* dst, VkDeviceSize size)
@@ -88,10 +101,15 @@ void Buffer::Copy(Buffer* dst, VkDeviceSize size)
 
 void Buffer::CopyToImage(Image& image, uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t layers)
 {
-    VkDeviceSize layerSize = static_cast<VkDeviceSize>(width) * height * bytesPerPixel;
-
     CommandBuffer commandBuffer;
     commandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    CopyToImage(commandBuffer, image, width, height, bytesPerPixel, layers);
+    commandBuffer.SubmitIdle();
+}
+
+void Buffer::CopyToImage(CommandBuffer& commandBuffer, Image& image, uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t layers)
+{
+    VkDeviceSize layerSize = static_cast<VkDeviceSize>(width) * height * bytesPerPixel;
 
     std::vector<VkBufferImageCopy> regions;
     regions.resize(layers);
@@ -119,8 +137,36 @@ void Buffer::CopyToImage(Image& image, uint32_t width, uint32_t height, uint32_t
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         static_cast<uint32_t>(regions.size()),
         regions.data());
+}
 
-    commandBuffer.SubmitIdle();
+void Buffer::CopyToImageMips(CommandBuffer& commandBuffer, Image& image, std::span<const uint64_t> mipOffsets)
+{
+    std::vector<VkBufferImageCopy> regions;
+    regions.resize(mipOffsets.size());
+
+    for(uint32_t i = 0; i < regions.size(); ++i)
+    {
+        VkBufferImageCopy& region = regions[i];
+        region.bufferOffset       = mipOffsets[i];
+        region.bufferRowLength    = 0;
+        region.bufferImageHeight  = 0;
+
+        region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel       = i;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount     = 1;
+
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {std::max(image.GetWidth() >> i, 1u), std::max(image.GetHeight() >> i, 1u), 1};
+    }
+
+    vkCmdCopyBufferToImage(
+        commandBuffer.GetCommandBuffer(),
+        m_buffer,
+        image.GetImage(),
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(regions.size()),
+        regions.data());
 }
 
 void Buffer::Fill(const void* data, uint64_t size, uint64_t offset)
@@ -2,7 +2,9 @@
 #include "Image.hpp"
 #include "VulkanContext.hpp"
 #include "CommandBuffer.hpp"
+#include "BindlessHeap.hpp"
 #include <cstring>
+#include <span>
 #include <vk_mem_alloc.h>
 
 
@@ -34,9 +36,13 @@ public:
           m_buffer(other.m_buffer),
           m_size(other.m_size),
           m_nonCoherentAtomeSize(other.m_nonCoherentAtomeSize),
-          m_allocation(other.m_allocation)
+          m_allocation(other.m_allocation),
+          m_mappedMemory(other.m_mappedMemory),
+          m_bindlessIndex(other.m_bindlessIndex)
     {
-        other.m_buffer = VK_NULL_HANDLE;
+        other.m_buffer        = VK_NULL_HANDLE;
+        other.m_mappedMemory  = nullptr;
+        other.m_bindlessIndex = BindlessHeap::INVALID_INDEX;
     }
 
     Buffer& operator=(const Buffer& other) = delete;
@@ -54,8 +60,12 @@ public:
         m_size                 = other.m_size;
         m_nonCoherentAtomeSize = other.m_nonCoherentAtomeSize;
         m_allocation           = other.m_allocation;
+        m_mappedMemory         = other.m_mappedMemory;
+        m_bindlessIndex        = other.m_bindlessIndex;
 
-        other.m_buffer = VK_NULL_HANDLE;
+        other.m_buffer        = VK_NULL_HANDLE;
+        other.m_mappedMemory  = nullptr;
+        other.m_bindlessIndex = BindlessHeap::INVALID_INDEX;
         return *this;
     }
 
@@ -63,6 +73,11 @@ public:
     void Free();
     void Copy(Buffer* dst, VkDeviceSize size = 0);
     void CopyToImage(Image& image, uint32_t width, uint32_t height, uint32_t bytesPerPixel = 4, uint32_t layers = 1);
+    // only records the copy into commandBuffer, image has to be in transfer dst layout when it executes
+    void CopyToImage(CommandBuffer& commandBuffer, Image& image, uint32_t width, uint32_t height, uint32_t bytesPerPixel = 4, uint32_t layers = 1);
+    // records a copy of every mip of image, mip i starts at mipOffsets[i] and is tightly packed (works for block compressed
+    // formats too)
+    void CopyToImageMips(CommandBuffer& commandBuffer, Image& image, std::span<const uint64_t> mipOffsets);
     template<typename T>
     void Fill(const std::vector<T>& data, uint64_t offset = 0)
     {
@@ -76,6 +91,10 @@ public:
     void Bind(const CommandBuffer& commandBuffer);
     [[nodiscard]] const VkBuffer& GetVkBuffer() const { return m_buffer; }
     [[nodiscard]] VkDeviceSize GetSize() const { return m_size; }
+    // index into the bindless heap, BindlessHeap::INVALID_INDEX unless the buffer was created with storage buffer usage
+    [[nodiscard]] uint32_t GetBindlessIndex() const { return m_bindlessIndex; }
+    // persistently mapped memory of mappable buffers, nullptr otherwise. It may be write combined, write it sequentially and never read it
+    [[nodiscard]] void* GetMappedMemory() const { return m_mappedMemory; }
     [[nodiscard]] uint64_t GetDeviceAddress() const
     {
         VkBufferDeviceAddressInfo info = {};
@@ -110,4 +129,6 @@ protected:
 
     VmaAllocation m_allocation;
     void* m_mappedMemory = nullptr;
+
+    uint32_t m_bindlessIndex = BindlessHeap::INVALID_INDEX;
 };
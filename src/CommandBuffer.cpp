@@ -1,7 +1,18 @@
 #include "CommandBuffer.hpp"
+#include "BindlessHeap.hpp"
 #include "VulkanContext.hpp"
 #include <limits>
 
+namespace
+{
+// descriptors written since the last submit (e.g. while loading outside a frame) have to land before the GPU reads the heap
+void FlushBindlessHeap()
+{
+    if(BindlessHeap* heap = VulkanContext::GetBindlessHeap())
+        heap->Flush();
+}
+}
+
 CommandBuffer::CommandBuffer(VkCommandBufferLevel level)
     : m_recording(false),
       m_commandBuffer(VK_NULL_HANDLE),
@@ -42,6 +53,7 @@ void CommandBuffer::Begin(VkCommandBufferUsageFlags usage)
 
     VK_CHECK(vkBeginCommandBuffer(m_commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
     m_recording = true;
+    m_boundDescriptorSets.clear();
 }
 void CommandBuffer::Begin(VkCommandBufferUsageFlags usage, VkCommandBufferInheritanceInfo inheritanceInfo)
 {
@@ -52,6 +64,7 @@ void CommandBuffer::Begin(VkCommandBufferUsageFlags usage, VkCommandBufferInheri
 
     VK_CHECK(vkBeginCommandBuffer(m_commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
     m_recording = true;
+    m_boundDescriptorSets.clear();
 }
 
 void CommandBuffer::End()
@@ -80,6 +93,7 @@ void CommandBuffer::SubmitIdle()
 
     VK_CHECK(vkCreateFence(VulkanContext::GetDevice(), &fenceInfo, nullptr, &fence), "Failed to create fence");
     VK_CHECK(vkResetFences(VulkanContext::GetDevice(), 1, &fence), "Failed to reset fence");
+    FlushBindlessHeap();
     VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, fence), "Failed to submit queue");
     VK_CHECK(vkWaitForFences(VulkanContext::GetDevice(), 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max()), "Failed to wait for fence");
     vkDestroyFence(VulkanContext::GetDevice(), fence, nullptr);
@@ -113,6 +127,7 @@ void CommandBuffer::Submit(VkSemaphore waitSemaphore, VkPipelineStageFlags waitS
         VK_CHECK(vkResetFences(VulkanContext::GetDevice(), 1, &fence), "Failed to reset fence");
     }
 
+    FlushBindlessHeap();
     VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, fence), "Failed to submit command buffer" + std::to_string((uint64_t)m_commandBuffer));
 }
 
@@ -140,6 +155,7 @@ void CommandBuffer::Submit(const std::vector<VkSemaphore>& waitSemaphores, const
         VK_CHECK(vkResetFences(VulkanContext::GetDevice(), 1, &fence), "Failed to reset fence");
     }
 
+    FlushBindlessHeap();
     VK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, fence), "Failed to submit command buffer");
 }
 
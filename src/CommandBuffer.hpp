@@ -24,13 +24,24 @@ public:
         return m_commandBuffer;
     }
 
+    // descriptor sets last bound by Pipeline::Bind, pipelines sharing a pipeline layout skip rebinding the sets that are still bound
+    struct BoundDescriptorSets
+    {
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> sets;
+    };
+    BoundDescriptorSets& GetBoundDescriptorSets(VkPipelineBindPoint bindPoint) { return m_boundDescriptorSets[bindPoint]; }
+    // needed after recording anything that binds descriptors without going through Pipeline::Bind, e.g. ImGui
+    void InvalidateBoundDescriptorSets() { m_boundDescriptorSets.clear(); }
+
     CommandBuffer(const CommandBuffer& other) = delete;
 
     CommandBuffer(CommandBuffer&& other) noexcept
         : m_recording(other.m_recording),
           m_commandBuffer(other.m_commandBuffer),
           m_queue(other.m_queue),
-          m_commandPool(other.m_commandPool)
+          m_commandPool(other.m_commandPool),
+          m_boundDescriptorSets(std::move(other.m_boundDescriptorSets))
     {
         other.m_commandBuffer = VK_NULL_HANDLE;
     }
@@ -46,6 +57,8 @@ public:
         m_queue         = other.m_queue;
         m_commandPool   = other.m_commandPool;
 
+        m_boundDescriptorSets = std::move(other.m_boundDescriptorSets);
+
         other.m_commandBuffer = VK_NULL_HANDLE;
         return *this;
     }
@@ -55,4 +68,6 @@ private:
     VkCommandBuffer m_commandBuffer;
     VkQueue m_queue;
     VkCommandPool m_commandPool;
+
+    std::unordered_map<VkPipelineBindPoint, BoundDescriptorSets> m_boundDescriptorSets;
 };
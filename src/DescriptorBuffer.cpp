@@ -0,0 +1,181 @@
+#include "DescriptorBuffer.hpp"
+#include "Renderer.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <cstring>
+
+DescriptorBufferSet::DescriptorBufferSet(const DescriptorSetLayoutBuilder& builder, VkDescriptorSetLayout layout)
+{
+    VkDeviceSize size = 0;
+    vkGetDescriptorSetLayoutSizeEXT(VulkanContext::GetDevice(), layout, &size);
+    m_data.resize(size);
+
+    for(const auto& binding : builder.bindings)
+    {
+        VkDeviceSize offset = 0;
+        vkGetDescriptorSetLayoutBindingOffsetEXT(VulkanContext::GetDevice(), layout, binding.binding, &offset);
+        m_bindings[binding.binding] = {.offset = offset, .count = binding.descriptorCount};
+    }
+}
+
+void DescriptorBufferSet::Write(uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info)
+{
+    auto it = m_bindings.find(binding);
+    if(it == m_bindings.end() || element >= it->second.count)
+    {
+        Log::Error("Descriptor buffer set has no binding {} element {}", binding, element);
+        return;
+    }
+
+    const DescriptorBuffer* descriptorBuffer = VulkanContext::GetDescriptorBuffer();
+
+    VkDescriptorGetInfoEXT getInfo{};
+    getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+    getInfo.type  = type;
+
+    VkDescriptorAddressInfoEXT addressInfo{};
+    switch(type)
+    {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+        getInfo.data.pSampler = &info.image.sampler;
+        break;
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        getInfo.data.pCombinedImageSampler = &info.image;
+        break;
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        getInfo.data.pSampledImage = &info.image;
+        break;
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        getInfo.data.pStorageImage = &info.image;
+        break;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        {
+            // buffers are referenced by address, which is why Buffer adds SHADER_DEVICE_ADDRESS to uniform and storage buffers
+            VkBufferDeviceAddressInfo bufferAddressInfo{};
+            bufferAddressInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+            bufferAddressInfo.buffer = info.buffer.buffer;
+
+            addressInfo.sType   = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+            addressInfo.address = vkGetBufferDeviceAddress(VulkanContext::GetDevice(), &bufferAddressInfo) + info.buffer.offset;
+            addressInfo.range   = info.buffer.range;
+            addressInfo.format  = VK_FORMAT_UNDEFINED;
+
+            if(type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+                getInfo.data.pUniformBuffer = &addressInfo;
+            else
+                getInfo.data.pStorageBuffer = &addressInfo;
+            break;
+        }
+    case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+        {
+            VkAccelerationStructureDeviceAddressInfoKHR accelerationStructureAddressInfo{};
+            accelerationStructureAddressInfo.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+            accelerationStructureAddressInfo.accelerationStructure = info.accelerationStructure;
+
+            getInfo.data.accelerationStructure = vkGetAccelerationStructureDeviceAddressKHR(VulkanContext::GetDevice(), &accelerationStructureAddressInfo);
+            break;
+        }
+    default:
+        Log::Error("Descriptor type {} isn't supported by descriptor buffers", string_VkDescriptorType(type));
+        return;
+    }
+
+    const auto& properties = descriptorBuffer->GetProperties();
+    VkDeviceSize size      = descriptorBuffer->GetDescriptorSize(type);
+    VkDeviceSize offset    = it->second.offset;
+
+    if(type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER && !properties.combinedImageSamplerDescriptorSingleArray)
+    {
+        // the image and sampler halves live in two separate arrays: all the images of the binding followed by all the samplers
+        std::vector<uint8_t> descriptor(size);
+        vkGetDescriptorEXT(VulkanContext::GetDevice(), &getInfo, size, descriptor.data());
+
+        VkDeviceSize imageOffset   = offset + element * properties.sampledImageDescriptorSize;
+        VkDeviceSize samplerOffset = offset + it->second.count * properties.sampledImageDescriptorSize + element * properties.samplerDescriptorSize;
+        std::memcpy(m_data.data() + imageOffset, descriptor.data(), properties.sampledImageDescriptorSize);
+        std::memcpy(m_data.data() + samplerOffset, descriptor.data() + properties.sampledImageDescriptorSize, properties.samplerDescriptorSize);
+        return;
+    }
+
+    vkGetDescriptorEXT(VulkanContext::GetDevice(), &getInfo, size, m_data.data() + offset + element * size);
+}
+
+DescriptorBuffer::DescriptorBuffer()
+{
+    m_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &m_properties;
+    vkGetPhysicalDeviceProperties2(VulkanContext::GetPhysicalDevice(), &properties2);
+
+    // samplers and resources share the same buffer so it has to respect the limits of both
+    VkDeviceSize maxRange = std::min(m_properties.maxResourceDescriptorBufferRange, m_properties.maxSamplerDescriptorBufferRange);
+    m_sliceSize           = std::min(SIZE_PER_FRAME, maxRange / Renderer::MAX_FRAMES_IN_FLIGHT);
+    m_sliceSize          -= m_sliceSize % m_properties.descriptorBufferOffsetAlignment;
+
+    m_buffer.Allocate(m_sliceSize * Renderer::MAX_FRAMES_IN_FLIGHT,
+                      VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                      true,
+                      static_cast<uint32_t>(m_properties.descriptorBufferOffsetAlignment));
+    m_address = m_buffer.GetDeviceAddress();
+
+    VK_SET_DEBUG_NAME(m_buffer.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, "Descriptor buffer");
+}
+
+void DescriptorBuffer::BeginFrame(uint32_t frameIndex)
+{
+    m_sliceBegin = frameIndex * m_sliceSize;
+    m_offset     = 0;
+}
+
+VkDeviceSize DescriptorBuffer::Upload(const DescriptorBufferSet& set)
+{
+    const auto& data = set.GetData();
+    if(m_offset + data.size() > m_sliceSize)
+    {
+        Log::Error("Descriptor buffer ran out of space for this frame ({} bytes per frame)", m_sliceSize);
+        abort();
+    }
+
+    VkDeviceSize offset = m_sliceBegin + m_offset;
+    if(!data.empty())
+        m_buffer.Fill(data.data(), data.size(), offset);
+
+    VkDeviceSize alignment = m_properties.descriptorBufferOffsetAlignment;
+    m_offset               = (m_offset + data.size() + alignment - 1) / alignment * alignment;
+    return offset;
+}
+
+void DescriptorBuffer::Bind(VkCommandBuffer cb) const
+{
+    VkDescriptorBufferBindingInfoEXT bindingInfo{};
+    bindingInfo.sType   = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+    bindingInfo.address = m_address;
+    bindingInfo.usage   = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    vkCmdBindDescriptorBuffersEXT(cb, 1, &bindingInfo);
+}
+
+VkDeviceSize DescriptorBuffer::GetDescriptorSize(VkDescriptorType type) const
+{
+    switch(type)
+    {
+    case VK_DESCRIPTOR_TYPE_SAMPLER:
+        return m_properties.samplerDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        return m_properties.combinedImageSamplerDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        return m_properties.sampledImageDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        return m_properties.storageImageDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        return m_properties.uniformBufferDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        return m_properties.storageBufferDescriptorSize;
+    case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+        return m_properties.accelerationStructureDescriptorSize;
+    default:
+        Log::Error("Descriptor type {} isn't supported by descriptor buffers", string_VkDescriptorType(type));
+        return 0;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "DescriptorSet.hpp"
+#include "VulkanContext.hpp"
+#include <unordered_map>
+#include <vector>
+
+// CPU side copy of one descriptor set in the memory layout the driver expects inside a descriptor buffer (VK_EXT_descriptor_buffer).
+// Writes go straight through vkGetDescriptorEXT so there is no pool or VkDescriptorSet involved at all
+class DescriptorBufferSet
+{
+public:
+    DescriptorBufferSet(const DescriptorSetLayoutBuilder& builder, VkDescriptorSetLayout layout);
+
+    void Write(uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info);
+
+    [[nodiscard]] const std::vector<uint8_t>& GetData() const { return m_data; }
+
+private:
+    struct BindingInfo
+    {
+        VkDeviceSize offset;
+        uint32_t count;
+    };
+
+    std::vector<uint8_t> m_data;
+    std::unordered_map<uint32_t, BindingInfo> m_bindings;
+};
+
+// GPU visible ring of descriptor memory split into one slice per frame in flight.
+// Every Pipeline::Bind copies its sets into a fresh part of the current slice, so descriptors can change between dispatches
+// without having to wait for the GPU, and there is no pool that can run out
+class DescriptorBuffer
+{
+public:
+    static constexpr VkDeviceSize SIZE_PER_FRAME = 4 * 1024 * 1024;
+
+    DescriptorBuffer();
+
+    DescriptorBuffer(const DescriptorBuffer& other)            = delete;
+    DescriptorBuffer& operator=(const DescriptorBuffer& other) = delete;
+
+    // called by the renderer once the fence of frameIndex has been waited on
+    void BeginFrame(uint32_t frameIndex);
+
+    // copies the set into the current frame's slice, returns its offset to pass to vkCmdSetDescriptorBufferOffsetsEXT
+    VkDeviceSize Upload(const DescriptorBufferSet& set);
+    void Bind(VkCommandBuffer cb) const;
+
+    [[nodiscard]] VkDeviceSize GetDescriptorSize(VkDescriptorType type) const;
+    [[nodiscard]] const VkPhysicalDeviceDescriptorBufferPropertiesEXT& GetProperties() const { return m_properties; }
+
+private:
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT m_properties{};
+
+    Buffer m_buffer;
+    VkDeviceAddress m_address = 0;
+    VkDeviceSize m_sliceSize  = 0;
+
+    VkDeviceSize m_sliceBegin = 0;
+    VkDeviceSize m_offset     = 0;
+};
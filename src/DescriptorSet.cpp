@@ -1,8 +1,11 @@
 #include "DescriptorSet.hpp"
 #include "VulkanContext.hpp"
+#include "Sampler.hpp"
 #include <set>
+#include <algorithm>
+#include <numeric>
 
-void DescriptorSetLayoutBuilder::AddBinding(uint32_t binding, VkDescriptorType t, uint32_t count)
+void DescriptorSetLayoutBuilder::AddBinding(uint32_t binding, VkDescriptorType t, uint32_t count, bool variableSize)
 {
     VkDescriptorSetLayoutBinding b{};
     b.binding         = binding;
@@ -10,6 +13,7 @@ void DescriptorSetLayoutBuilder::AddBinding(uint32_t binding, VkDescriptorType t
     b.descriptorType  = t;
 
     bindings.push_back(b);
+    isVariableSize.push_back(variableSize);
 }
 
 VkDescriptorSetLayout DescriptorSetLayoutBuilder::Build(VkShaderStageFlags stageFlags, VkDescriptorSetLayoutCreateFlags flags)
@@ -18,14 +22,25 @@ VkDescriptorSetLayout DescriptorSetLayoutBuilder::Build(VkShaderStageFlags stage
     {
         binding.stageFlags = stageFlags;
     }
+    // push descriptors are recorded into the command buffer so none of the update after bind stuff applies to them (and isn't allowed)
+    bool isPushDescriptor = flags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    // descriptor buffer layouts are just plain memory, the pool/set binding flags don't apply to them
+    bool isDescriptorBuffer = flags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+
     VkDescriptorSetLayoutCreateInfo ci{};
     ci.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    ci.flags        = flags | VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    ci.flags        = isPushDescriptor || isDescriptorBuffer ? flags : flags | VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
     ci.bindingCount = static_cast<uint32_t>(bindings.size());
     ci.pBindings    = bindings.data();
 
+    VkDescriptorBindingFlags flagsPerBinding = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    if(isPushDescriptor)
+        flagsPerBinding = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    if(isDescriptorBuffer)
+        flagsPerBinding = 0;
+
     VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCi = {};
-    std::vector<VkDescriptorBindingFlags> bindingFlags(bindings.size(), VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT);
+    std::vector<VkDescriptorBindingFlags> bindingFlags(bindings.size(), flagsPerBinding);
 
     bindingFlagsCi.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
     bindingFlagsCi.pBindingFlags = bindingFlags.data();
@@ -43,6 +58,7 @@ VkDescriptorSetLayout DescriptorSetLayoutBuilder::Build(VkShaderStageFlags stage
 void DescriptorSetLayoutBuilder::operator+=(const DescriptorSetLayoutBuilder& other)
 {
     bindings.append_range(other.bindings);
+    isVariableSize.append_range(other.isVariableSize);
     std::set<uint32_t> s;
     for(auto binding : bindings)
     {
@@ -53,3 +69,410 @@ void DescriptorSetLayoutBuilder::operator+=(const DescriptorSetLayoutBuilder& ot
         s.insert(binding.binding);
     }
 }
+
+
+std::size_t DescriptorWriter::KeyHash::operator()(const Key& key) const noexcept
+{
+    std::size_t result = 0;
+    hashCombine(result, key.set);
+    hashCombine(result, key.binding);
+    hashCombine(result, key.element);
+    return result;
+}
+
+void DescriptorWriter::Write(VkDescriptorSet set, uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info)
+{
+    auto [it, inserted] = m_indices.try_emplace(Key{set, binding, element}, m_writes.size());
+    if(!inserted)
+    {
+        // a pending write already targets this descriptor, just replace what it points to
+        m_writes[it->second].descriptorType = type;
+        m_infos[it->second]                 = info;
+        return;
+    }
+
+    VkWriteDescriptorSet write{};
+    write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet          = set;
+    write.dstBinding      = binding;
+    write.dstArrayElement = element;
+    write.descriptorCount = 1;
+    write.descriptorType  = type;
+
+    m_writes.push_back(write);
+    m_infos.push_back(info);
+}
+
+void DescriptorWriter::Discard(VkDescriptorSet set, uint32_t binding, uint32_t element)
+{
+    auto it = m_indices.find(Key{set, binding, element});
+    if(it == m_indices.end())
+        return;
+
+    // move the last write into the hole so the other indices stay valid
+    size_t index = it->second;
+    m_indices.erase(it);
+    if(index != m_writes.size() - 1)
+    {
+        m_writes[index] = m_writes.back();
+        m_infos[index]  = m_infos.back();
+
+        const auto& moved                                                     = m_writes[index];
+        m_indices[Key{moved.dstSet, moved.dstBinding, moved.dstArrayElement}] = index;
+    }
+    m_writes.pop_back();
+    m_infos.pop_back();
+}
+
+void DescriptorWriter::Flush()
+{
+    if(m_writes.empty())
+        return;
+
+    ResolveInfos();
+    vkUpdateDescriptorSets(VulkanContext::GetDevice(), static_cast<uint32_t>(m_writes.size()), m_writes.data(), 0, nullptr);
+    Clear();
+}
+
+void DescriptorWriter::Push(VkCommandBuffer cb, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set)
+{
+    if(m_writes.empty())
+        return;
+
+    ResolveInfos();
+    vkCmdPushDescriptorSetKHR(cb, bindPoint, layout, set, static_cast<uint32_t>(m_writes.size()), m_writes.data());
+    Clear();
+}
+
+void DescriptorWriter::ResolveInfos()
+{
+    m_accelerationStructureWrites.clear();
+    m_accelerationStructureWrites.reserve(m_writes.size());  // pNext points into this so it must not reallocate
+    for(size_t i = 0; i < m_writes.size(); i++)
+    {
+        auto& write = m_writes[i];
+        switch(write.descriptorType)
+        {
+        case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+            {
+                auto& asWrite                      = m_accelerationStructureWrites.emplace_back();
+                asWrite.sType                      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+                asWrite.accelerationStructureCount = 1;
+                asWrite.pAccelerationStructures    = &m_infos[i].accelerationStructure;
+
+                write.pNext = &asWrite;
+                break;
+            }
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            write.pBufferInfo = &m_infos[i].buffer;
+            break;
+        default:
+            write.pImageInfo = &m_infos[i].image;
+            break;
+        }
+    }
+}
+
+void DescriptorWriter::Clear()
+{
+    m_writes.clear();
+    m_infos.clear();
+    m_indices.clear();
+}
+
+DescriptorSetTemplate::DescriptorSetTemplate(const DescriptorSetLayoutBuilder& builder, VkDescriptorSetLayout layout)
+{
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    for(size_t i = 0; i < builder.bindings.size(); i++)
+    {
+        const auto& binding = builder.bindings[i];
+        if(builder.isVariableSize[i])
+            continue;
+
+        switch(binding.descriptorType)
+        {
+        case VK_DESCRIPTOR_TYPE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+            break;
+        default:
+            continue;  // no DescriptorInfo representation for these
+        }
+
+        VkDescriptorUpdateTemplateEntry entry{};
+        entry.dstBinding      = binding.binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = binding.descriptorCount;
+        entry.descriptorType  = binding.descriptorType;
+        entry.offset          = m_slotCount * sizeof(DescriptorInfo);
+        entry.stride          = sizeof(DescriptorInfo);
+        entries.push_back(entry);
+
+        m_ranges[binding.binding]  = {.firstSlot = m_slotCount, .count = binding.descriptorCount, .type = binding.descriptorType};
+        m_slotCount               += binding.descriptorCount;
+    }
+
+    if(entries.empty() || layout == VK_NULL_HANDLE)
+        return;
+
+    VkDescriptorUpdateTemplateCreateInfo ci{};
+    ci.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    ci.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    ci.pDescriptorUpdateEntries   = entries.data();
+    ci.templateType               = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    ci.descriptorSetLayout        = layout;
+
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(VulkanContext::GetDevice(), &ci, nullptr, &m_template), "Failed to create descriptor update template");
+}
+
+DescriptorSetTemplate::~DescriptorSetTemplate()
+{
+    if(m_template != VK_NULL_HANDLE)
+        vkDestroyDescriptorUpdateTemplate(VulkanContext::GetDevice(), m_template, nullptr);
+}
+
+DescriptorSetShadow DescriptorSetTemplate::CreateShadow() const
+{
+    DescriptorSetShadow shadow{};
+    shadow.data.resize(m_slotCount);
+    shadow.written.resize(m_slotCount, false);
+    return shadow;
+}
+
+bool DescriptorSetTemplate::Write(DescriptorSetShadow& shadow, uint32_t binding, uint32_t element, const DescriptorInfo& info) const
+{
+    auto it = m_ranges.find(binding);
+    if(it == m_ranges.end() || element >= it->second.count)
+        return false;
+
+    uint32_t slot     = it->second.firstSlot + element;
+    shadow.data[slot] = info;
+    if(!shadow.written[slot])
+    {
+        shadow.written[slot] = true;
+        shadow.writtenCount++;
+    }
+    shadow.dirty = true;
+    return true;
+}
+
+void DescriptorSetTemplate::Flush(DescriptorSetShadow& shadow, VkDescriptorSet set, DescriptorWriter& fallback) const
+{
+    if(!shadow.dirty)
+        return;
+    shadow.dirty = false;
+
+    if(shadow.writtenCount == m_slotCount)
+    {
+        vkUpdateDescriptorSetWithTemplate(VulkanContext::GetDevice(), set, m_template, shadow.data.data());
+        return;
+    }
+
+    Enqueue(shadow, set, fallback);
+}
+
+void DescriptorSetTemplate::Enqueue(const DescriptorSetShadow& shadow, VkDescriptorSet set, DescriptorWriter& writer) const
+{
+    for(const auto& [binding, range] : m_ranges)
+    {
+        for(uint32_t i = 0; i < range.count; i++)
+        {
+            if(shadow.written[range.firstSlot + i])
+                writer.Write(set, binding, i, range.type, shadow.data[range.firstSlot + i]);
+        }
+    }
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+    for(const auto& [layout, layoutPools] : m_layouts)
+    {
+        for(auto pool : layoutPools.pools)
+            vkDestroyDescriptorPool(VulkanContext::GetDevice(), pool, nullptr);
+    }
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout, const DescriptorSetLayoutBuilder& builder)
+{
+    std::scoped_lock lock(m_mutex);
+
+    auto [it, inserted]      = m_layouts.try_emplace(layout);
+    LayoutPools& layoutPools = it->second;
+    if(inserted)
+    {
+        for(const auto& binding : builder.bindings)
+        {
+            auto size = std::ranges::find(layoutPools.sizesPerSet, binding.descriptorType, &VkDescriptorPoolSize::type);
+            if(size == layoutPools.sizesPerSet.end())
+                layoutPools.sizesPerSet.push_back({binding.descriptorType, binding.descriptorCount});
+            else
+                size->descriptorCount += binding.descriptorCount;
+        }
+    }
+    if(layoutPools.sizesPerSet.empty())
+        return VK_NULL_HANDLE;
+
+    if(!layoutPools.freeSets.empty())
+    {
+        VkDescriptorSet set = layoutPools.freeSets.back();
+        layoutPools.freeSets.pop_back();
+        return set;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts        = &layout;
+
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    if(!layoutPools.pools.empty())
+    {
+        allocInfo.descriptorPool = layoutPools.pools.back();
+        VkResult result          = vkAllocateDescriptorSets(VulkanContext::GetDevice(), &allocInfo, &set);
+        if(result == VK_SUCCESS)
+            return set;
+        if(result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+            VK_CHECK(result, "Failed to allocate descriptor set");
+
+        layoutPools.setsPerPool = std::min(layoutPools.setsPerPool * 2, 256u);
+    }
+
+    // the last pool is full (or there is none yet)
+    layoutPools.pools.push_back(CreatePool(layoutPools));
+    allocInfo.descriptorPool = layoutPools.pools.back();
+    VK_CHECK(vkAllocateDescriptorSets(VulkanContext::GetDevice(), &allocInfo, &set), "Failed to allocate descriptor set");
+    return set;
+}
+
+void DescriptorAllocator::Free(VkDescriptorSetLayout layout, VkDescriptorSet set)
+{
+    std::scoped_lock lock(m_mutex);
+
+    if(!m_layouts.contains(layout))
+    {
+        Log::Error("Trying to free a descriptor set whose layout wasn't allocated from this allocator");
+        return;
+    }
+    m_released[m_frameIndex].emplace_back(layout, set);
+}
+
+void DescriptorAllocator::BeginFrame(uint32_t frameIndex)
+{
+    std::scoped_lock lock(m_mutex);
+    m_frameIndex = frameIndex;
+    for(auto [layout, set] : m_released[frameIndex])
+        m_layouts[layout].freeSets.push_back(set);
+    m_released[frameIndex].clear();
+}
+
+VkDescriptorPool DescriptorAllocator::CreatePool(const LayoutPools& layoutPools)
+{
+    std::vector<VkDescriptorPoolSize> poolSizes = layoutPools.sizesPerSet;
+    for(auto& size : poolSizes)
+        size.descriptorCount *= layoutPools.setsPerPool;
+
+    VkDescriptorPoolCreateInfo createInfo = {};
+    createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    createInfo.poolSizeCount              = static_cast<uint32_t>(poolSizes.size());
+    createInfo.pPoolSizes                 = poolSizes.data();
+    createInfo.maxSets                    = layoutPools.setsPerPool;
+    createInfo.flags                      = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;  // the layouts are built with UPDATE_AFTER_BIND_POOL
+
+    VkDescriptorPool pool;
+    VK_CHECK(vkCreateDescriptorPool(VulkanContext::GetDevice(), &createInfo, nullptr, &pool), "Failed to create descriptor pool");
+    return pool;
+}
+
+DescriptorLayoutCache::~DescriptorLayoutCache()
+{
+    for(const auto& [key, layout] : m_pipelineLayouts)
+        vkDestroyPipelineLayout(VulkanContext::GetDevice(), layout, nullptr);
+    for(const auto& [key, layout] : m_setLayouts)
+        vkDestroyDescriptorSetLayout(VulkanContext::GetDevice(), layout, nullptr);
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::GetSetLayout(const DescriptorSetLayoutBuilder& builder, VkShaderStageFlags stageFlags, VkDescriptorSetLayoutCreateFlags flags)
+{
+    DescriptorSetLayoutBuilder sorted;
+    std::vector<uint32_t> order(builder.bindings.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::sort(order, {}, [&](uint32_t i) { return builder.bindings[i].binding; });
+    for(uint32_t i : order)
+        sorted.AddBinding(builder.bindings[i].binding, builder.bindings[i].descriptorType, builder.bindings[i].descriptorCount, builder.isVariableSize[i]);
+
+    SetLayoutKey key{.stageFlags = stageFlags, .flags = flags};
+    for(const auto& binding : sorted.bindings)
+        key.bindings.push_back({binding.binding, binding.descriptorType, binding.descriptorCount});
+
+    std::scoped_lock lock(m_mutex);
+    auto [it, inserted] = m_setLayouts.try_emplace(std::move(key), VK_NULL_HANDLE);
+    if(inserted)
+    {
+        it->second = sorted.Build(stageFlags, flags);
+        auto name  = std::format("dsl_{}", m_setLayouts.size() - 1);
+        VK_SET_DEBUG_NAME(it->second, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, name.c_str());
+    }
+    return it->second;
+}
+
+VkPipelineLayout DescriptorLayoutCache::GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges)
+{
+    PipelineLayoutKey key{.setLayouts = setLayouts};
+    for(const auto& range : pushConstantRanges)
+        key.pushConstantRanges.push_back({range.stageFlags, range.offset, range.size});
+    std::ranges::sort(key.pushConstantRanges, [](const auto& a, const auto& b) { return std::tie(a.offset, a.stageFlags) < std::tie(b.offset, b.stageFlags); });
+
+    std::scoped_lock lock(m_mutex);
+    auto it = m_pipelineLayouts.find(key);
+    if(it != m_pipelineLayouts.end())
+        return it->second;
+
+    std::vector<VkPushConstantRange> ranges;
+    for(const auto& range : key.pushConstantRanges)
+        ranges.push_back({range.stageFlags, range.offset, range.size});
+
+    VkPipelineLayoutCreateInfo createInfo = {};
+    createInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    createInfo.setLayoutCount             = static_cast<uint32_t>(setLayouts.size());
+    createInfo.pSetLayouts                = setLayouts.data();
+    createInfo.pushConstantRangeCount     = static_cast<uint32_t>(ranges.size());
+    createInfo.pPushConstantRanges        = ranges.data();
+
+    VkPipelineLayout layout;
+    VK_CHECK(vkCreatePipelineLayout(VulkanContext::GetDevice(), &createInfo, nullptr, &layout), "Failed to create pipeline layout");
+    m_pipelineLayouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+std::size_t DescriptorLayoutCache::KeyHash::operator()(const SetLayoutKey& key) const noexcept
+{
+    std::size_t result = 0;
+    hashCombine(result, key.stageFlags);
+    hashCombine(result, key.flags);
+    for(const auto& binding : key.bindings)
+    {
+        hashCombine(result, binding.binding);
+        hashCombine(result, binding.type);
+        hashCombine(result, binding.count);
+    }
+    return result;
+}
+
+std::size_t DescriptorLayoutCache::KeyHash::operator()(const PipelineLayoutKey& key) const noexcept
+{
+    std::size_t result = 0;
+    for(auto layout : key.setLayouts)
+        hashCombine(result, layout);
+    for(const auto& range : key.pushConstantRanges)
+    {
+        hashCombine(result, range.stageFlags);
+        hashCombine(result, range.offset);
+        hashCombine(result, range.size);
+    }
+    return result;
+}
@@ -1,12 +1,227 @@
 #pragma once
+#include "VulkanContext.hpp"
 #include <volk.h>
+#include <array>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
 
 
 struct DescriptorSetLayoutBuilder
 {
-    void AddBinding(uint32_t binding, VkDescriptorType t, uint32_t count = 1);
+    void AddBinding(uint32_t binding, VkDescriptorType t, uint32_t count = 1, bool variableSize = false);
     VkDescriptorSetLayout Build(VkShaderStageFlags stageFlags = VK_SHADER_STAGE_ALL, VkDescriptorSetLayoutCreateFlags flags = 0);
     void operator+=(const DescriptorSetLayoutBuilder& other);
     std::vector<VkDescriptorSetLayoutBinding> bindings;
+    std::vector<bool> isVariableSize;  // same indexing as bindings
+};
+
+union DescriptorInfo
+{
+    VkDescriptorImageInfo image;
+    VkDescriptorBufferInfo buffer;
+    VkAccelerationStructureKHR accelerationStructure;
+};
+
+// Collects descriptor writes so that they can be submitted with a single vkUpdateDescriptorSets call.
+// Writing the same set/binding/element multiple times before a flush only keeps the last write.
+class DescriptorWriter
+{
+public:
+    void Write(VkDescriptorSet set, uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info);
+    // drops a pending write, e.g. because the resource it points to is getting destroyed before the next flush
+    void Discard(VkDescriptorSet set, uint32_t binding, uint32_t element);
+    void Flush();
+    // records the writes with vkCmdPushDescriptorSetKHR instead, the target sets of the writes are ignored
+    void Push(VkCommandBuffer cb, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set);
+
+    [[nodiscard]] bool IsEmpty() const { return m_writes.empty(); }
+
+private:
+    void ResolveInfos();
+    void Clear();
+
+    struct Key
+    {
+        VkDescriptorSet set;
+        uint32_t binding;
+        uint32_t element;
+
+        bool operator==(const Key& other) const = default;
+    };
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const noexcept;
+    };
+
+    // infos are stored by value and only get pointed to right before flushing,
+    // so the vectors can grow without invalidating the pending writes
+    std::vector<VkWriteDescriptorSet> m_writes;
+    std::vector<DescriptorInfo> m_infos;
+    std::vector<VkWriteDescriptorSetAccelerationStructureKHR> m_accelerationStructureWrites;
+    std::unordered_map<Key, size_t, KeyHash> m_indices;
+};
+
+// CPU side copy of the descriptors of a set, in the packed layout expected by its DescriptorSetTemplate
+struct DescriptorSetShadow
+{
+    std::vector<DescriptorInfo> data;
+    std::vector<bool> written;
+    uint32_t writtenCount = 0;
+    bool dirty            = false;
+};
+
+// Descriptor update template covering every fixed size binding of a set, so that a whole set
+// can be written from its shadow with one vkUpdateDescriptorSetWithTemplate call.
+// Variable sized arrays are left out since they are only partially filled, those still go through a DescriptorWriter.
+class DescriptorSetTemplate
+{
+public:
+    // layout can be VK_NULL_HANDLE to only get the shadow layout without a VkDescriptorUpdateTemplate, e.g. for push descriptors
+    DescriptorSetTemplate(const DescriptorSetLayoutBuilder& builder, VkDescriptorSetLayout layout);
+    ~DescriptorSetTemplate();
+
+    DescriptorSetTemplate(const DescriptorSetTemplate& other) = delete;
+
+    DescriptorSetTemplate(DescriptorSetTemplate&& other) noexcept
+        : m_template(other.m_template),
+          m_ranges(std::move(other.m_ranges)),
+          m_slotCount(other.m_slotCount)
+    {
+        other.m_template = VK_NULL_HANDLE;
+    }
+
+    DescriptorSetTemplate& operator=(const DescriptorSetTemplate& other) = delete;
+
+    DescriptorSetTemplate& operator=(DescriptorSetTemplate&& other) noexcept
+    {
+        if(this == &other)
+            return *this;
+        std::swap(m_template, other.m_template);
+        m_ranges    = std::move(other.m_ranges);
+        m_slotCount = other.m_slotCount;
+        return *this;
+    }
+
+    [[nodiscard]] DescriptorSetShadow CreateShadow() const;
+
+    // returns false if the binding isn't covered by the template
+    bool Write(DescriptorSetShadow& shadow, uint32_t binding, uint32_t element, const DescriptorInfo& info) const;
+
+    // Writes the shadow to the set if it changed. As long as some descriptors haven't been written yet
+    // we can't use the template, so the ones we have get queued in the fallback writer instead
+    void Flush(DescriptorSetShadow& shadow, VkDescriptorSet set, DescriptorWriter& fallback) const;
+
+    // queues every descriptor of the shadow that has been written
+    void Enqueue(const DescriptorSetShadow& shadow, VkDescriptorSet set, DescriptorWriter& writer) const;
+
+private:
+    struct Range
+    {
+        uint32_t firstSlot;
+        uint32_t count;
+        VkDescriptorType type;
+    };
+
+    VkDescriptorUpdateTemplate m_template = VK_NULL_HANDLE;
+    std::unordered_map<uint32_t, Range> m_ranges;  // binding -> range
+    uint32_t m_slotCount = 0;
+};
+
+// Hands out descriptor sets from pools that get created on demand. Every layout has its own chain of pools sized from its
+// bindings, so pools only reserve the descriptor types that will actually be allocated from them and there is no hard cap on
+// the number of sets. Each new pool in a chain holds twice as many sets as the previous one.
+// Freed sets are kept and handed out again for the next allocation with the same layout once the frames that could still be using
+// them have finished. Layouts without bindings don't get any pools, allocating from them returns VK_NULL_HANDLE
+class DescriptorAllocator
+{
+public:
+    DescriptorAllocator() = default;
+    ~DescriptorAllocator();
+
+    DescriptorAllocator(const DescriptorAllocator& other)            = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator& other) = delete;
+
+    VkDescriptorSet Allocate(VkDescriptorSetLayout layout, const DescriptorSetLayoutBuilder& builder);
+    void Free(VkDescriptorSetLayout layout, VkDescriptorSet set);
+
+    // called by the renderer once the fence of frameIndex has been waited on
+    void BeginFrame(uint32_t frameIndex);
+
+private:
+    struct LayoutPools
+    {
+        std::vector<VkDescriptorPoolSize> sizesPerSet;
+        std::vector<VkDescriptorPool> pools;
+        std::vector<VkDescriptorSet> freeSets;
+        uint32_t setsPerPool = 4;
+    };
+
+    static VkDescriptorPool CreatePool(const LayoutPools& layoutPools);
+
+    std::mutex m_mutex;
+    std::unordered_map<VkDescriptorSetLayout, LayoutPools> m_layouts;
+
+    // sets freed while recording a frame, they are recycled when that frame slot comes around again
+    std::array<std::vector<std::pair<VkDescriptorSetLayout, VkDescriptorSet>>, NUM_FRAMES_IN_FLIGHT> m_released;
+    uint32_t m_frameIndex = 0;
+};
+
+// Hands out one VkDescriptorSetLayout per distinct set of bindings and one VkPipelineLayout per distinct combination of
+// set layouts and push constant ranges. Bindings are sorted before hashing so shaders declaring them in a different order still
+// share a layout, and pipelines with the same pipeline layout are compatible so their sets stay bound when switching between them.
+// Everything lives until the cache gets destroyed
+class DescriptorLayoutCache
+{
+public:
+    DescriptorLayoutCache() = default;
+    ~DescriptorLayoutCache();
+
+    DescriptorLayoutCache(const DescriptorLayoutCache& other)            = delete;
+    DescriptorLayoutCache& operator=(const DescriptorLayoutCache& other) = delete;
+
+    VkDescriptorSetLayout GetSetLayout(const DescriptorSetLayoutBuilder& builder, VkShaderStageFlags stageFlags = VK_SHADER_STAGE_ALL, VkDescriptorSetLayoutCreateFlags flags = 0);
+    VkPipelineLayout GetPipelineLayout(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges);
+
+private:
+    struct SetLayoutKey
+    {
+        struct Binding
+        {
+            uint32_t binding;
+            VkDescriptorType type;
+            uint32_t count;
+
+            bool operator==(const Binding& other) const = default;
+        };
+        std::vector<Binding> bindings;  // sorted by binding
+        VkShaderStageFlags stageFlags;
+        VkDescriptorSetLayoutCreateFlags flags;
+
+        bool operator==(const SetLayoutKey& other) const = default;
+    };
+    struct PipelineLayoutKey
+    {
+        struct PushConstantRange
+        {
+            VkShaderStageFlags stageFlags;
+            uint32_t offset;
+            uint32_t size;
+
+            bool operator==(const PushConstantRange& other) const = default;
+        };
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<PushConstantRange> pushConstantRanges;  // sorted by offset
+
+        bool operator==(const PipelineLayoutKey& other) const = default;
+    };
+    struct KeyHash
+    {
+        std::size_t operator()(const SetLayoutKey& key) const noexcept;
+        std::size_t operator()(const PipelineLayoutKey& key) const noexcept;
+    };
+
+    std::mutex m_mutex;
+    std::unordered_map<SetLayoutKey, VkDescriptorSetLayout, KeyHash> m_setLayouts;
+    std::unordered_map<PipelineLayoutKey, VkPipelineLayout, KeyHash> m_pipelineLayouts;
 };
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// std::hash isn't guaranteed to give the same value in every run, this one is for hashes that end up in file names
+inline uint64_t HashFNV1a(std::string_view data, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for(char c : data)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
@@ -34,7 +34,9 @@ Image::Image(uint32_t width, uint32_t height, ImageCreateInfo createInfo) : m_wi
 
     if(createInfo.image == VK_NULL_HANDLE)
     {
-        if(createInfo.msaaSamples == VK_SAMPLE_COUNT_1_BIT && createInfo.useMips)
+        if(createInfo.msaaSamples == VK_SAMPLE_COUNT_1_BIT && createInfo.useMips && createInfo.mipLevels > 0)
+            m_mipLevels = createInfo.mipLevels;
+        else if(createInfo.msaaSamples == VK_SAMPLE_COUNT_1_BIT && createInfo.useMips)
             m_mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(m_width, m_height)))) + 1;
         else
             m_mipLevels = 1;
@@ -110,6 +112,18 @@ Image::Image(uint32_t width, uint32_t height, ImageCreateInfo createInfo) : m_wi
     {
         m_sampler = SamplerConfig();
     }
+
+    // storage images get written and sampled without transitioning in between
+    m_sampledLayout = createInfo.usage & VK_IMAGE_USAGE_STORAGE_BIT ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+
+    BindlessHeap* heap = VulkanContext::GetBindlessHeap();
+    if(heap && !m_onlyHandleImageView)
+    {
+        if(createInfo.usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+            m_sampledIndex = heap->RegisterSampledImage(m_imageViews[0], m_sampledLayout, m_sampler.value());
+        if(createInfo.usage & VK_IMAGE_USAGE_STORAGE_BIT)
+            m_storageIndex = heap->RegisterStorageImage(m_imageViews[0]);
+    }
 }
 
 Image::Image(VkExtent2D extent, ImageCreateInfo createInfo) : Image(extent.width, extent.height, createInfo)
@@ -264,6 +278,14 @@ void Image::Free()
     if(m_image == VK_NULL_HANDLE || m_imageViews[0] == VK_NULL_HANDLE)
         return;
 
+    if(BindlessHeap* heap = VulkanContext::GetBindlessHeap())
+    {
+        heap->Release(BindlessHeap::SAMPLED_IMAGE, m_sampledIndex);
+        heap->Release(BindlessHeap::STORAGE_IMAGE, m_storageIndex);
+    }
+    m_sampledIndex = BindlessHeap::INVALID_INDEX;
+    m_storageIndex = BindlessHeap::INVALID_INDEX;
+
     for(auto& imageView : m_imageViews)
     {
         vkDestroyImageView(VulkanContext::GetDevice(), imageView, nullptr);
@@ -322,7 +344,12 @@ void Image::TransitionLayout(VkImageLayout newLayout)
 {
     CommandBuffer commandBuffer;
     commandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    TransitionLayout(commandBuffer, newLayout);
+    commandBuffer.SubmitIdle();
+}
 
+void Image::TransitionLayout(CommandBuffer& commandBuffer, VkImageLayout newLayout)
+{
     VkImageMemoryBarrier barrier = {};
     barrier.sType                = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout            = m_layout;
@@ -357,7 +384,6 @@ void Image::TransitionLayout(VkImageLayout newLayout)
                          0, nullptr, 0, nullptr,  // these are for other types of barriers
                          1, &barrier);
 
-    commandBuffer.SubmitIdle();
     m_layout = newLayout;
 }
 
@@ -369,6 +395,21 @@ void Image::GenerateMipmaps(VkImageLayout newLayout)
         TransitionLayout(newLayout);
         return;
     }
+
+    CommandBuffer commandBuffer;
+    commandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    GenerateMipmaps(commandBuffer, newLayout);
+    commandBuffer.SubmitIdle();
+}
+
+void Image::GenerateMipmaps(CommandBuffer& commandBuffer, VkImageLayout newLayout)
+{
+    // small textures legitimately end up with a single mip, no need to warn here
+    if(m_mipLevels == 1)
+    {
+        TransitionLayout(commandBuffer, newLayout);
+        return;
+    }
     // Check if image format supports linear blitting
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(VulkanContext::GetPhysicalDevice(), m_format, &formatProperties);
@@ -377,10 +418,6 @@ void Image::GenerateMipmaps(VkImageLayout newLayout)
         throw std::runtime_error("Texture image format does not support linear blitting!");
     }
 
-
-    CommandBuffer commandBuffer;
-    commandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
     VkImageMemoryBarrier barrier            = {};
     barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image                           = m_image;
@@ -473,11 +510,33 @@ void Image::GenerateMipmaps(VkImageLayout newLayout)
                          0, nullptr,
                          1, &barrier);
 
-    commandBuffer.SubmitIdle();
-
     m_layout = newLayout;
 }
 
+void Image::SetSamplerConfig(SamplerConfig config)
+{
+    m_sampler = config;
+    UpdateBindlessDescriptor();
+}
+
+void Image::SetPlaceholder(const Image* placeholder)
+{
+    m_placeholder = placeholder;
+    UpdateBindlessDescriptor();
+}
+
+void Image::UpdateBindlessDescriptor()
+{
+    // the sampled descriptor stores the sampler so it has to follow it, the layout is fixed
+    BindlessHeap* heap = VulkanContext::GetBindlessHeap();
+    if(!heap || m_sampledIndex == BindlessHeap::INVALID_INDEX)
+        return;
+    if(m_placeholder)
+        heap->UpdateSampledImage(m_sampledIndex, m_placeholder->m_imageViews[0], m_placeholder->m_sampledLayout, m_sampler.value_or(SamplerConfig{}));
+    else
+        heap->UpdateSampledImage(m_sampledIndex, m_imageViews[0], m_sampledLayout, m_sampler.value_or(SamplerConfig{}));
+}
+
 VkImageMemoryBarrier2 Image::GetBarrier(VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags2 srcStage, VkAccessFlagBits2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlagBits2 dstAccess)
 {
     VkImageMemoryBarrier2 barrier{};
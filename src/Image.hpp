@@ -1,6 +1,8 @@
 #pragma once
 #include "Sampler.hpp"
 #include "VulkanContext.hpp"
+#include "BindlessHeap.hpp"
+#include "CommandBuffer.hpp"
 #include <filesystem>
 #include <volk.h>
 #include <vk_mem_alloc.h>
@@ -19,6 +21,7 @@ struct ImageCreateInfo
     VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
     bool useMips = true;
+    uint32_t mipLevels = 0;  // only with useMips, 0 means the full chain
 
     uint8_t layerCount = 1;
 
@@ -49,11 +52,17 @@ public:
           m_layout(other.m_layout),
           m_aspect(other.m_aspect),
           m_usage(other.m_usage),
+          m_sampledLayout(other.m_sampledLayout),
           m_onlyHandleImageView(other.m_onlyHandleImageView),
           m_allocation(other.m_allocation),
-          m_sampler(other.m_sampler)
+          m_sampler(other.m_sampler),
+          m_sampledIndex(other.m_sampledIndex),
+          m_storageIndex(other.m_storageIndex),
+          m_placeholder(other.m_placeholder)
     {
-        other.m_image = VK_NULL_HANDLE;
+        other.m_image        = VK_NULL_HANDLE;
+        other.m_sampledIndex = BindlessHeap::INVALID_INDEX;
+        other.m_storageIndex = BindlessHeap::INVALID_INDEX;
     }
 
     Image& operator=(const Image& other) = delete;
@@ -74,11 +83,17 @@ public:
         m_layout              = other.m_layout;
         m_aspect              = other.m_aspect;
         m_usage               = other.m_usage;
+        m_sampledLayout       = other.m_sampledLayout;
         m_onlyHandleImageView = other.m_onlyHandleImageView;
         m_allocation          = other.m_allocation;
         m_sampler             = other.m_sampler;
+        m_sampledIndex        = other.m_sampledIndex;
+        m_storageIndex        = other.m_storageIndex;
+        m_placeholder         = other.m_placeholder;
 
-        other.m_image = VK_NULL_HANDLE;
+        other.m_image        = VK_NULL_HANDLE;
+        other.m_sampledIndex = BindlessHeap::INVALID_INDEX;
+        other.m_storageIndex = BindlessHeap::INVALID_INDEX;
         return *this;
     }
 
@@ -86,12 +101,19 @@ public:
     void Free();
     void TransitionLayout(VkImageLayout newLayout);
     void GenerateMipmaps(VkImageLayout newLayout);
+    // Only record into commandBuffer. The bindless descriptor isn't touched, the caller has to make sure the image isn't sampled
+    // before the commands ran (e.g. with SetPlaceholder)
+    void TransitionLayout(CommandBuffer& commandBuffer, VkImageLayout newLayout);
+    void GenerateMipmaps(CommandBuffer& commandBuffer, VkImageLayout newLayout);
 
 
     VkImageView CreateImageView(uint32_t mip);
 
     VkImageView GetImageView(uint32_t index = 0) const { return m_imageViews[index]; }
     VkImageLayout GetLayout() const { return m_layout; }
+    // The bindless descriptor is written with this layout once and never follows transitions, since frames still in flight may be
+    // reading it. READ_ONLY_OPTIMAL, or GENERAL for storage images. The image has to be back in it whenever it's sampled through the heap
+    VkImageLayout GetSampledLayout() const { return m_sampledLayout; }
     VkImage GetImage() const { return m_image; }
     VkFormat GetFormat() const { return m_format; }
     VkImageUsageFlags GetUsage() const { return m_usage; }
@@ -105,9 +127,22 @@ public:
 
     VkImageMemoryBarrier2 GetBarrier(VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags2 srcStage, VkAccessFlagBits2 srcAccess, VkPipelineStageFlags2 dstStage, VkAccessFlagBits2 dstAccess);
 
-    void SetSamplerConfig(SamplerConfig config) { m_sampler = config; }
+    void SetSamplerConfig(SamplerConfig config);
     std::optional<SamplerConfig> GetSamplerConfig() const { return m_sampler; }
 
+    // While set the sampled descriptor shows placeholder (with this image's sampler) instead of this image, e.g. until the
+    // contents finished uploading. placeholder has to outlive the time it is set
+    void SetPlaceholder(const Image* placeholder);
+    // false while a placeholder is set. Descriptors written outside the bindless heap (Shader::SetParameter) get the placeholder
+    // until then, so they have to be written again once this returns true
+    bool IsReady() const { return m_placeholder == nullptr; }
+    // the image sampled descriptors should point at, i.e. the placeholder while one is set
+    const Image& GetSampledSource() const { return m_placeholder ? *m_placeholder : *this; }
+
+    // indices into the bindless heap, BindlessHeap::INVALID_INDEX if the image wasn't created with the matching usage
+    uint32_t GetSampledIndex() const { return m_sampledIndex; }
+    uint32_t GetStorageIndex() const { return m_storageIndex; }
+
 protected:
     uint32_t m_mipLevels;
 
@@ -119,8 +154,9 @@ protected:
     VkImageLayout m_layout;
     VkImageAspectFlags m_aspect;
     VkImageUsageFlags m_usage;
-    uint32_t m_layerCount = 1;
-    bool m_isCubeMap      = false;
+    VkImageLayout m_sampledLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL;
+    uint32_t m_layerCount         = 1;
+    bool m_isCubeMap              = false;
     std::string m_debugName;
 
     bool m_onlyHandleImageView = false;
@@ -128,4 +164,12 @@ protected:
     VmaAllocation m_allocation;
 
     std::optional<SamplerConfig> m_sampler;
+
+    uint32_t m_sampledIndex = BindlessHeap::INVALID_INDEX;
+    uint32_t m_storageIndex = BindlessHeap::INVALID_INDEX;
+
+    const Image* m_placeholder = nullptr;
+
+private:
+    void UpdateBindlessDescriptor();
 };
@@ -0,0 +1,90 @@
+#include "IndirectDispatch.hpp"
+#include "BindlessHeap.hpp"
+#include "Shader.hpp"
+#include "Log.hpp"
+#include <format>
+
+namespace
+{
+// the entry point's uniform parameters end up in push constants
+constexpr const char* GENERATE_ARGS_SOURCE = R"(
+[[vk::binding({}, {})]] RWByteAddressBuffer buffers[];
+
+[shader("compute")]
+[numthreads(1, 1, 1)]
+void main(uniform uint countBuffer, uniform uint countOffset, uniform uint argsBuffer, uniform uint argsOffset, uniform uint threadsPerGroup, uniform uint maxGroupCountX)
+{{
+    uint count  = buffers[countBuffer].Load(countOffset);
+    uint groups = (count + threadsPerGroup - 1) / threadsPerGroup;
+
+    uint3 args = uint3(min(groups, maxGroupCountX), (groups + maxGroupCountX - 1) / maxGroupCountX, 1);
+    buffers[argsBuffer].Store3(argsOffset, args);
+}}
+)";
+}
+
+void IndirectDispatch::CreatePipeline()
+{
+    ShaderCompileOptions options;
+    options.source = std::format(GENERATE_ARGS_SOURCE, static_cast<uint32_t>(BindlessHeap::STORAGE_BUFFER), BindlessHeap::SET);
+
+    m_shader = std::make_shared<Shader>("generate_dispatch_args.slang", VK_SHADER_STAGE_COMPUTE_BIT, "main", options);
+
+    PipelineCreateInfo createInfo{};
+    createInfo.type    = PipelineType::COMPUTE;
+    createInfo.shaders = {m_shader};
+    m_pipeline         = std::make_unique<Pipeline>("generate_dispatch_args", createInfo);
+}
+
+void IndirectDispatch::GenerateArgs(CommandBuffer& cb, uint32_t frameIndex, const Buffer& countBuffer, VkDeviceSize countOffset, const Buffer& args, VkDeviceSize argsOffset, const Shader& consumer)
+{
+    GenerateArgs(cb, frameIndex, countBuffer, countOffset, args, argsOffset, consumer.GetThreadGroupSize()[0]);
+}
+
+void IndirectDispatch::GenerateArgs(CommandBuffer& cb, uint32_t frameIndex, const Buffer& countBuffer, VkDeviceSize countOffset, const Buffer& args, VkDeviceSize argsOffset, uint32_t threadsPerGroup)
+{
+    if(countBuffer.GetBindlessIndex() == BindlessHeap::INVALID_INDEX || args.GetBindlessIndex() == BindlessHeap::INVALID_INDEX)
+    {
+        Log::Error("The count and args buffers of an indirect dispatch need storage buffer usage");
+        return;
+    }
+    assert(countOffset % 4 == 0 && argsOffset % 4 == 0);
+    assert(argsOffset + sizeof(VkDispatchIndirectCommand) <= args.GetSize());
+    assert(threadsPerGroup > 0);
+
+    if(!m_pipeline)
+        CreatePipeline();
+
+    VkMemoryBarrier2 countBarrier{};
+    countBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    countBarrier.srcStageMask  = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    countBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    countBarrier.dstStageMask  = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    countBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+    VkDependencyInfo dependency{};
+    dependency.sType              = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers    = &countBarrier;
+    vkCmdPipelineBarrier2(cb.GetCommandBuffer(), &dependency);
+
+    m_shader->SetParameter(frameIndex, "countBuffer", countBuffer.GetBindlessIndex());
+    m_shader->SetParameter(frameIndex, "countOffset", static_cast<uint32_t>(countOffset));
+    m_shader->SetParameter(frameIndex, "argsBuffer", args.GetBindlessIndex());
+    m_shader->SetParameter(frameIndex, "argsOffset", static_cast<uint32_t>(argsOffset));
+    m_shader->SetParameter(frameIndex, "threadsPerGroup", threadsPerGroup);
+    m_shader->SetParameter(frameIndex, "maxGroupCountX", VulkanContext::GetPhysicalDeviceProperties().limits.maxComputeWorkGroupCount[0]);
+
+    m_pipeline->Bind(cb, frameIndex);
+    vkCmdDispatch(cb.GetCommandBuffer(), 1, 1, 1);
+
+    VkMemoryBarrier2 argsBarrier{};
+    argsBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    argsBarrier.srcStageMask  = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    argsBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    argsBarrier.dstStageMask  = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    argsBarrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+    dependency.pMemoryBarriers = &argsBarrier;
+    vkCmdPipelineBarrier2(cb.GetCommandBuffer(), &dependency);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "CommandBuffer.hpp"
+#include "Pipeline.hpp"
+#include <memory>
+
+class Shader;
+
+// Turns counts produced on the GPU (culling output, compaction, ...) into VkDispatchIndirectCommands so a later pass can be
+// sized by an earlier one without reading the count back:
+//      cull.Dispatch(cb, objectCount, 1, 1);                                    // writes the visible count into counts
+//      indirect->GenerateArgs(cb, frameIndex, counts, 0, args, 0, *drawSetup);  // args = ceil(count / drawSetup's group size)
+//      drawSetupPipeline.Bind(cb, frameIndex);
+//      drawSetup->DispatchIndirect(cb, args);
+// Both buffers are accessed through the bindless heap, so they need storage buffer usage, args also indirect buffer usage.
+// The kernel gets compiled on first use
+class IndirectDispatch
+{
+public:
+    IndirectDispatch() = default;
+
+    IndirectDispatch(const IndirectDispatch& other)            = delete;
+    IndirectDispatch& operator=(const IndirectDispatch& other) = delete;
+
+    // Writes {ceil(count / threadsPerGroup), 1, 1} to args at argsOffset, count being the uint at countOffset in countBuffer.
+    // More groups than maxComputeWorkGroupCount[0] spill into y, consumers that can get that many have to flatten the group id
+    // and skip the threads past the count.
+    // Records the barriers from compute writes of the count to this pass and from this pass to indirect and compute reads.
+    // Leaves its own pipeline bound
+    void GenerateArgs(CommandBuffer& cb, uint32_t frameIndex, const Buffer& countBuffer, VkDeviceSize countOffset, const Buffer& args, VkDeviceSize argsOffset, uint32_t threadsPerGroup);
+    // threadsPerGroup is the x thread group size of consumer
+    void GenerateArgs(CommandBuffer& cb, uint32_t frameIndex, const Buffer& countBuffer, VkDeviceSize countOffset, const Buffer& args, VkDeviceSize argsOffset, const Shader& consumer);
+
+private:
+    void CreatePipeline();
+
+    std::unique_ptr<Pipeline> m_pipeline;
+    std::shared_ptr<Shader> m_shader;
+};
@@ -0,0 +1,298 @@
+#include "Ktx2.hpp"
+#include "VulkanContext.hpp"
+#include "Log.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <basisu_transcoder.h>
+#include <cstring>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vulkan/utility/vk_format_utils.h>
+#include <zstd.h>
+
+namespace
+{
+constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+constexpr uint32_t SUPERCOMPRESSION_NONE = 0;
+constexpr uint32_t SUPERCOMPRESSION_ZSTD = 2;
+
+// copy offsets have to be a multiple of the texel block size, 16 covers every format
+constexpr uint64_t MIP_ALIGNMENT = 16;
+
+// all little endian and naturally aligned, so it can be copied out of the file as is
+struct Header
+{
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(Header) == 80);
+
+struct LevelIndex
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+static_assert(sizeof(LevelIndex) == 24);
+
+bool SupportsSampling(VkFormat format)
+{
+    constexpr VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(VulkanContext::GetPhysicalDevice(), format, &properties);
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct TranscodeTarget
+{
+    basist::transcoder_texture_format basisFormat;
+    VkFormat format;
+};
+
+// The smallest format the device can sample that keeps the channels the texture has. BC4 and BC5 have no sRGB variants,
+// they are only used for data like normal maps or roughness
+TranscodeTarget ChooseTarget(const basist::ktx2_transcoder& transcoder, bool srgb)
+{
+    uint32_t channels = 4;
+    if(transcoder.is_etc1s() && transcoder.get_dfd_channel_id0() == basist::KTX2_DF_CHANNEL_ETC1S_RRR)
+        channels = transcoder.get_dfd_channel_id1() == basist::KTX2_DF_CHANNEL_ETC1S_GGG ? 2 : 1;
+    else if(transcoder.is_uastc() && transcoder.get_dfd_channel_id0() == basist::KTX2_DF_CHANNEL_UASTC_RRR)
+        channels = 1;
+    else if(transcoder.is_uastc() && transcoder.get_dfd_channel_id0() == basist::KTX2_DF_CHANNEL_UASTC_RG)
+        channels = 2;
+
+    if(!srgb && channels == 1 && SupportsSampling(VK_FORMAT_BC4_UNORM_BLOCK))
+        return {basist::transcoder_texture_format::cTFBC4_R, VK_FORMAT_BC4_UNORM_BLOCK};
+    if(!srgb && channels == 2 && SupportsSampling(VK_FORMAT_BC5_UNORM_BLOCK))
+        return {basist::transcoder_texture_format::cTFBC5_RG, VK_FORMAT_BC5_UNORM_BLOCK};
+
+    const VkFormat bc7 = srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    if(SupportsSampling(bc7))
+        return {basist::transcoder_texture_format::cTFBC7_RGBA, bc7};
+
+    const VkFormat astc = srgb ? VK_FORMAT_ASTC_4x4_SRGB_BLOCK : VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+    if(SupportsSampling(astc))
+        return {basist::transcoder_texture_format::cTFASTC_4x4_RGBA, astc};
+
+    return {basist::transcoder_texture_format::cTFRGBA32, srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM};
+}
+
+Ktx2Upload PrepareBasis(std::span<const uint8_t> data, const Header& header, bool srgb)
+{
+    static std::once_flag initialized;
+    std::call_once(initialized, basist::basisu_transcoder_init);
+
+    // the transcoder only reads the header and level index here, it's shared with the worker that transcodes the mips
+    auto transcoder = std::make_shared<basist::ktx2_transcoder>();
+    if(!transcoder->init(data.data(), static_cast<uint32_t>(data.size())))
+        throw std::runtime_error("invalid Basis Universal KTX2 file");
+
+    const TranscodeTarget target = ChooseTarget(*transcoder, srgb);
+    const bool uncompressed      = basist::basis_transcoder_format_is_uncompressed(target.basisFormat);
+    const uint32_t bytesPerBlock = basist::basis_get_bytes_per_block_or_pixel(target.basisFormat);
+
+    Ktx2Upload upload{};
+    upload.width  = header.pixelWidth;
+    upload.height = header.pixelHeight;
+    upload.format = target.format;
+
+    // in blocks, or pixels for the uncompressed fallback
+    std::vector<uint32_t> mipBlocks;
+    uint64_t offset = 0;
+    for(uint32_t level = 0; level < std::max(transcoder->get_levels(), 1u); ++level)
+    {
+        const uint32_t width  = std::max(upload.width >> level, 1u);
+        const uint32_t height = std::max(upload.height >> level, 1u);
+        const uint32_t blocks = uncompressed ? width * height : ((width + 3) / 4) * ((height + 3) / 4);
+
+        offset = AlignUp(offset, MIP_ALIGNMENT);
+        upload.mipOffsets.push_back(offset);
+        mipBlocks.push_back(blocks);
+        offset += static_cast<uint64_t>(blocks) * bytesPerBlock;
+    }
+    upload.size = offset;
+
+    upload.write = [transcoder, target, mipOffsets = upload.mipOffsets, mipBlocks](uint8_t* dst)
+    {
+        if(!transcoder->start_transcoding())
+            throw std::runtime_error("failed to start transcoding");
+        for(uint32_t level = 0; level < mipOffsets.size(); ++level)
+        {
+            if(!transcoder->transcode_image_level(level, 0, 0, dst + mipOffsets[level], mipBlocks[level], target.basisFormat))
+                throw std::runtime_error(std::format("failed to transcode mip {}", level));
+        }
+    };
+    return upload;
+}
+
+// the same texel data decoded as sRGB, format itself if it has no sRGB variant
+VkFormat GetSrgbFormat(VkFormat format)
+{
+    switch(format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+    case VK_FORMAT_B8G8R8A8_UNORM:
+        return VK_FORMAT_B8G8R8A8_SRGB;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+        return VK_FORMAT_BC2_SRGB_BLOCK;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+        return VK_FORMAT_BC3_SRGB_BLOCK;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+        return VK_FORMAT_BC7_SRGB_BLOCK;
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        return VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK;
+    case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+        return VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK;
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        return VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+        return VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
+        return VK_FORMAT_ASTC_5x5_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
+        return VK_FORMAT_ASTC_6x6_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+        return VK_FORMAT_ASTC_8x8_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
+        return VK_FORMAT_ASTC_10x10_SRGB_BLOCK;
+    case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
+        return VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+    default:
+        return format;
+    }
+}
+
+Ktx2Upload PrepareNative(std::span<const uint8_t> data, const Header& header, bool srgb)
+{
+    VkFormat format = static_cast<VkFormat>(header.vkFormat);
+    if(header.supercompressionScheme != SUPERCOMPRESSION_NONE && header.supercompressionScheme != SUPERCOMPRESSION_ZSTD)
+        throw std::runtime_error(std::format("unsupported supercompression scheme {}", header.supercompressionScheme));
+
+    // a texture used as color stored in a linear format, e.g. written by a tool that doesn't know what it's for
+    if(srgb && vkuFormatIsUNORM(format))
+    {
+        const VkFormat srgbFormat = GetSrgbFormat(format);
+        if(srgbFormat != format)
+            format = srgbFormat;
+        else
+            Log::Warn("KTX2 format {} has no sRGB variant, the color texture is sampled as linear", static_cast<uint32_t>(format));
+    }
+
+    const VKU_FORMAT_INFO formatInfo = vkuGetFormatInfo(format);
+    if(formatInfo.block_size == 0 || vkuFormatIsMultiplane(format))
+        throw std::runtime_error(std::format("unsupported format {}", static_cast<uint32_t>(format)));
+    if(!SupportsSampling(format))
+        throw std::runtime_error(std::format("format {} can't be sampled on this device", static_cast<uint32_t>(format)));
+
+    Ktx2Upload upload{};
+    upload.width  = header.pixelWidth;
+    upload.height = header.pixelHeight;
+    upload.format = format;
+
+    // levelCount 0 asks the loader to generate the mips, only the one that's there gets used
+    const uint32_t fullMipCount = std::bit_width(std::max(header.pixelWidth, header.pixelHeight));
+    if(header.levelCount > fullMipCount)
+        throw std::runtime_error(std::format("KTX2 file has {} mips, a {}x{} texture has at most {}", header.levelCount, header.pixelWidth, header.pixelHeight, fullMipCount));
+    std::vector<LevelIndex> levels(std::max(header.levelCount, 1u));
+    if(data.size() < sizeof(Header) + levels.size() * sizeof(LevelIndex))
+        throw std::runtime_error("KTX2 file is truncated");
+    std::memcpy(levels.data(), data.data() + sizeof(Header), levels.size() * sizeof(LevelIndex));
+
+    uint64_t offset = 0;
+    for(uint32_t i = 0; i < levels.size(); ++i)
+    {
+        const LevelIndex& level = levels[i];
+        if(level.byteOffset > data.size() || level.byteLength > data.size() - level.byteOffset)
+            throw std::runtime_error("KTX2 mip is outside of the file");
+
+        // the copy into the image reads exactly this much, a mismatch would read past the mip or leave it partly undefined
+        const uint64_t blocksX      = (std::max(header.pixelWidth >> i, 1u) + formatInfo.block_extent.width - 1) / formatInfo.block_extent.width;
+        const uint64_t blocksY      = (std::max(header.pixelHeight >> i, 1u) + formatInfo.block_extent.height - 1) / formatInfo.block_extent.height;
+        const uint64_t expectedSize = blocksX * blocksY * formatInfo.block_size;
+        if(level.uncompressedByteLength != expectedSize)
+            throw std::runtime_error(std::format("KTX2 mip {} has {} bytes instead of {}", i, level.uncompressedByteLength, expectedSize));
+
+        offset = AlignUp(offset, MIP_ALIGNMENT);
+        upload.mipOffsets.push_back(offset);
+        offset += level.uncompressedByteLength;
+    }
+    upload.size = offset;
+
+    upload.write = [data, levels, mipOffsets = upload.mipOffsets, zstd = header.supercompressionScheme == SUPERCOMPRESSION_ZSTD](uint8_t* dst)
+    {
+        std::vector<uint8_t> decompressed;
+        for(size_t i = 0; i < levels.size(); ++i)
+        {
+            const LevelIndex& level = levels[i];
+            const uint8_t* src      = data.data() + level.byteOffset;
+            if(zstd)
+            {
+                // zstd reads back what it already wrote, that must not happen in the write combined staging memory
+                decompressed.resize(level.uncompressedByteLength);
+                const size_t size = ZSTD_decompress(decompressed.data(), decompressed.size(), src, level.byteLength);
+                if(ZSTD_isError(size) || size != level.uncompressedByteLength)
+                    throw std::runtime_error(std::format("failed to decompress mip {}", i));
+                src = decompressed.data();
+            }
+            else if(level.byteLength != level.uncompressedByteLength)
+            {
+                throw std::runtime_error(std::format("mip {} has the wrong size", i));
+            }
+            std::memcpy(dst + mipOffsets[i], src, level.uncompressedByteLength);
+        }
+    };
+    return upload;
+}
+}
+
+bool IsKtx2(std::span<const uint8_t> data)
+{
+    return data.size() >= KTX2_IDENTIFIER.size() && std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), data.begin());
+}
+
+Ktx2Upload PrepareKtx2(std::span<const uint8_t> data, bool srgb)
+{
+    if(!IsKtx2(data) || data.size() < sizeof(Header))
+        throw std::runtime_error("not a KTX2 file");
+
+    Header header;
+    std::memcpy(&header, data.data(), sizeof(Header));
+    if(header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1)
+        throw std::runtime_error("only 2D KTX2 textures are supported");
+    if(header.layerCount > 1 || header.faceCount != 1)
+        throw std::runtime_error("KTX2 arrays and cube maps aren't supported");
+
+    // VK_FORMAT_UNDEFINED means the payload is Basis Universal
+    if(header.vkFormat == VK_FORMAT_UNDEFINED)
+        return PrepareBasis(data, header, srgb);
+    return PrepareNative(data, header, srgb);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <volk.h>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+// What it takes to get a KTX2 texture into an image: the format it ends up in and where each mip goes in staging memory
+struct Ktx2Upload
+{
+    uint32_t width;
+    uint32_t height;
+    VkFormat format;
+    std::vector<uint64_t> mipOffsets;
+    uint64_t size;  // staging bytes for all the mips
+    // Writes every mip to dst, sequentially. Meant for a worker thread, throws std::runtime_error for corrupt data.
+    // Keeps a reference to the file data, it has to stay alive until this ran
+    std::function<void(uint8_t* dst)> write;
+};
+
+bool IsKtx2(std::span<const uint8_t> data);
+
+// Reads the header of a KTX2 file and decides what its mips become on this device, the payload itself only gets touched
+// by write. Basis Universal payloads (ETC1S or UASTC, e.g. from KHR_texture_basisu) are transcoded to BC7, or BC5 / BC4 for
+// linear data with two / one channels, ASTC 4x4 without BC support and RGBA8 if the device has neither. Payloads already
+// in a GPU format are copied as they are, or zstd decompressed, a linear format is sampled as its sRGB variant if srgb is set.
+// Only 2D textures without layers or faces are supported, throws std::runtime_error for anything else
+Ktx2Upload PrepareKtx2(std::span<const uint8_t> data, bool srgb);
@@ -0,0 +1,111 @@
+#include "MappedFile.hpp"
+#include "Log.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return;
+    }
+    m_file   = file;
+    m_isOpen = true;
+    // mapping an empty file fails
+    if(size.QuadPart == 0)
+        return;
+
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!m_mapping)
+    {
+        Log::Warn("Failed to map {}", path.string());
+        Close();
+        return;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!m_data)
+    {
+        Log::Warn("Failed to map {}", path.string());
+        Close();
+        return;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+}
+
+void MappedFile::Close()
+{
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file)
+        CloseHandle(m_file);
+    m_data    = nullptr;
+    m_size    = 0;
+    m_mapping = nullptr;
+    m_file    = nullptr;
+    m_isOpen  = false;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return;
+
+    struct stat st{};
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return;
+    }
+    m_isOpen = true;
+    // mapping an empty file fails
+    if(st.st_size > 0)
+    {
+        void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+        {
+            Log::Warn("Failed to map {}", path.string());
+            m_isOpen = false;
+        }
+        else
+        {
+            m_data = static_cast<const uint8_t*>(data);
+            m_size = static_cast<size_t>(st.st_size);
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+}
+
+void MappedFile::Close()
+{
+    if(m_data)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    m_data   = nullptr;
+    m_size   = 0;
+    m_isOpen = false;
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
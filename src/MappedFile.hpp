@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+// Read only memory mapping of a whole file. Pages only get read from disk when they are touched,
+// so big assets can be used in place instead of being copied into memory first
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile& other)            = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : m_data(other.m_data),
+          m_size(other.m_size),
+          m_isOpen(other.m_isOpen)
+#ifdef _WIN32
+          ,
+          m_file(other.m_file),
+          m_mapping(other.m_mapping)
+#endif
+    {
+        other.m_data   = nullptr;
+        other.m_size   = 0;
+        other.m_isOpen = false;
+#ifdef _WIN32
+        other.m_file    = nullptr;
+        other.m_mapping = nullptr;
+#endif
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if(this == &other)
+            return *this;
+        Close();
+
+        m_data   = other.m_data;
+        m_size   = other.m_size;
+        m_isOpen = other.m_isOpen;
+#ifdef _WIN32
+        m_file    = other.m_file;
+        m_mapping = other.m_mapping;
+#endif
+
+        other.m_data   = nullptr;
+        other.m_size   = 0;
+        other.m_isOpen = false;
+#ifdef _WIN32
+        other.m_file    = nullptr;
+        other.m_mapping = nullptr;
+#endif
+        return *this;
+    }
+
+    // an empty file counts as open but has no data
+    [[nodiscard]] bool IsOpen() const { return m_isOpen; }
+    [[nodiscard]] std::span<const uint8_t> GetData() const { return {m_data, m_size}; }
+
+private:
+    void Close();
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size         = 0;
+    bool m_isOpen         = false;
+
+#ifdef _WIN32
+    void* m_file    = nullptr;  // HANDLE
+    void* m_mapping = nullptr;  // HANDLE
+#endif
+};
@@ -0,0 +1,241 @@
+#include "MeshOptimization.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+VertexCacheStats SimulateVertexCache(std::span<const uint32_t> indices, uint32_t cacheSize)
+{
+    VertexCacheStats stats{0, indices.size() / 3};
+    if(indices.empty())
+        return stats;
+
+    // a vertex is in the cache as long as fewer than cacheSize misses happened since it was inserted
+    std::vector<uint32_t> insertedAt(*std::ranges::max_element(indices) + 1, 0);
+    uint32_t time = cacheSize + 1;
+    for(uint32_t index : indices)
+    {
+        if(time - insertedAt[index] > cacheSize)
+        {
+            insertedAt[index] = time++;
+            ++stats.misses;
+        }
+    }
+    return stats;
+}
+
+size_t WeldVertices(std::vector<uint8_t>& vertices, size_t vertexSize, std::span<uint32_t> indices)
+{
+    const size_t vertexCount = vertices.size() / vertexSize;
+
+    // the keys point at the kept vertices, which are compacted to the front as they are found. A vertex only ever moves to a
+    // slot behind every key, so none of them gets overwritten
+    std::unordered_map<std::string_view, uint32_t> unique;
+    unique.reserve(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+    uint32_t kept = 0;
+    for(size_t i = 0; i < vertexCount; ++i)
+    {
+        uint8_t* vertex = vertices.data() + i * vertexSize;
+        auto it         = unique.find(std::string_view(reinterpret_cast<const char*>(vertex), vertexSize));
+        if(it != unique.end())
+        {
+            remap[i] = it->second;
+            continue;
+        }
+
+        uint8_t* slot = vertices.data() + static_cast<size_t>(kept) * vertexSize;
+        if(slot != vertex)
+            std::memcpy(slot, vertex, vertexSize);
+        unique.emplace(std::string_view(reinterpret_cast<const char*>(slot), vertexSize), kept);
+        remap[i] = kept++;
+    }
+
+    for(uint32_t& index : indices)
+        index = remap[index];
+    vertices.resize(static_cast<size_t>(kept) * vertexSize);
+    return kept;
+}
+
+void OptimizeTriangleOrder(std::span<uint32_t> indices, size_t vertexCount, const uint8_t* positions, size_t positionStride, uint32_t cacheSize)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if(triangleCount == 0)
+        return;
+
+    // triangles using each vertex
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for(uint32_t index : indices)
+        ++adjacencyOffsets[index + 1];
+    for(size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    {
+        std::vector<uint32_t> cursors(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(size_t i = 0; i < indices.size(); ++i)
+            adjacency[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        for(size_t v = 0; v < vertexCount; ++v)
+            liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    // in triangles of result. Small clusters would cost more cache misses once sorted than they could save in overdraw
+    std::vector<size_t> clusterStarts = {0};
+    const size_t minClusterTriangles  = cacheSize * 2;
+
+    uint32_t time      = cacheSize + 1;
+    size_t inputCursor = 0;
+    int64_t fanning    = 0;
+    while(fanning >= 0)
+    {
+        // emit every triangle around the fanning vertex that's still left
+        candidates.clear();
+        for(uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a)
+        {
+            const uint32_t triangle = adjacency[a];
+            if(emitted[triangle])
+                continue;
+            for(uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const uint32_t v = indices[triangle * 3 + corner];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if(time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[triangle] = 1;
+        }
+
+        // continue with the vertex that has triangles left and stays in the cache the longest while fanning around it
+        int64_t next     = -1;
+        int64_t priority = -1;
+        for(uint32_t v : candidates)
+        {
+            if(liveTriangles[v] == 0)
+                continue;
+            int64_t p = 0;
+            if(time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                p = time - cacheTime[v];
+            if(p > priority)
+            {
+                priority = p;
+                next     = v;
+            }
+        }
+        if(next >= 0)
+        {
+            fanning = next;
+            continue;
+        }
+
+        // dead end: the most recently used vertex that still has triangles, otherwise the next one in input order
+        while(next < 0 && !deadEnds.empty())
+        {
+            const uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if(liveTriangles[v] > 0)
+                next = v;
+        }
+        for(; next < 0 && inputCursor < vertexCount; ++inputCursor)
+        {
+            if(liveTriangles[inputCursor] > 0)
+                next = static_cast<int64_t>(inputCursor);
+        }
+        if(next >= 0 && result.size() / 3 - clusterStarts.back() >= minClusterTriangles)
+            clusterStarts.push_back(result.size() / 3);
+        fanning = next;
+    }
+    clusterStarts.push_back(triangleCount);
+
+    auto position = [&](uint32_t v)
+    {
+        glm::vec3 p;
+        std::memcpy(&p, positions + v * positionStride, sizeof(p));
+        return p;
+    };
+
+    // area weighted centroid and normal of every cluster and the whole mesh
+    struct Cluster
+    {
+        size_t first;
+        size_t count;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    std::vector<glm::vec3> clusterCentroids;
+    std::vector<glm::vec3> clusterNormals;
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for(size_t c = 0; c + 1 < clusterStarts.size(); ++c)
+    {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for(size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+        {
+            const glm::vec3 p0 = position(result[t * 3 + 0]);
+            const glm::vec3 p1 = position(result[t * 3 + 1]);
+            const glm::vec3 p2 = position(result[t * 3 + 2]);
+
+            const glm::vec3 n     = glm::cross(p1 - p0, p2 - p0);
+            const float triangle  = glm::length(n);
+            centroid             += (p0 + p1 + p2) * (triangle / 3.0f);
+            normal               += n;
+            area                 += triangle;
+        }
+        meshCentroid += centroid;
+        meshArea     += area;
+
+        clusters.push_back({clusterStarts[c], clusterStarts[c + 1] - clusterStarts[c], 0.0f});
+        clusterCentroids.push_back(area > 0.0f ? centroid / area : centroid);
+        clusterNormals.push_back(normal);
+    }
+    if(meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    for(size_t c = 0; c < clusters.size(); ++c)
+    {
+        const float length = glm::length(clusterNormals[c]);
+        if(length > 0.0f)
+            clusters[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c] / length);
+    }
+    std::ranges::stable_sort(clusters, std::ranges::greater{}, &Cluster::sortKey);
+
+    uint32_t* out = indices.data();
+    for(const Cluster& cluster : clusters)
+    {
+        std::memcpy(out, result.data() + cluster.first * 3, cluster.count * 3 * sizeof(uint32_t));
+        out += cluster.count * 3;
+    }
+}
+
+size_t OptimizeVertexFetch(std::vector<uint8_t>& vertices, size_t vertexSize, std::span<uint32_t> indices)
+{
+    constexpr uint32_t UNUSED = ~0u;
+
+    std::vector<uint32_t> remap(vertices.size() / vertexSize, UNUSED);
+    std::vector<uint8_t> reordered(vertices.size());
+    uint32_t next = 0;
+    for(uint32_t& index : indices)
+    {
+        if(remap[index] == UNUSED)
+        {
+            std::memcpy(reordered.data() + static_cast<size_t>(next) * vertexSize, vertices.data() + static_cast<size_t>(index) * vertexSize, vertexSize);
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    reordered.resize(static_cast<size_t>(next) * vertexSize);
+    vertices = std::move(reordered);
+    return next;
+}
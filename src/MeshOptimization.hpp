@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Result of simulating a post transform vertex cache, misses / triangles is the average cache miss ratio (ACMR)
+struct VertexCacheStats
+{
+    size_t misses;
+    size_t triangles;
+};
+
+// Simulates drawing the triangle list indices through a FIFO cache of cacheSize vertices
+VertexCacheStats SimulateVertexCache(std::span<const uint32_t> indices, uint32_t cacheSize = 16);
+
+// Merges vertices whose vertexSize bytes are identical and points indices at the one that's kept. vertices is shrunk to the
+// new count, which is returned. Every index has to be below vertices.size() / vertexSize
+size_t WeldVertices(std::vector<uint8_t>& vertices, size_t vertexSize, std::span<uint32_t> indices);
+
+// Reorders the triangles of the list indices for the vertex cache with Tipsify (Sander et al. 2007). The clusters it splits the
+// mesh into at dead ends are then sorted so the ones facing away from the mesh' center, which are the most likely to occlude
+// the rest, get drawn first. positions points at the float3 position of vertex 0, the next one is positionStride bytes further
+void OptimizeTriangleOrder(std::span<uint32_t> indices, size_t vertexCount, const uint8_t* positions, size_t positionStride, uint32_t cacheSize = 16);
+
+// Reorders vertices into the order indices first reference them in, so vertex fetches stream through memory, and rewrites
+// indices to match. Unreferenced vertices are dropped, returns the new vertex count
+size_t OptimizeVertexFetch(std::vector<uint8_t>& vertices, size_t vertexSize, std::span<uint32_t> indices);
@@ -1,51 +1,191 @@
 #include "Model.hpp"
 #define TINYGLTF_NO_STB_IMAGE_WRITE
+// images referenced by uri are decoded from our own mapping of the file
+#define TINYGLTF_NO_EXTERNAL_IMAGE
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
 
+#include "AccessorConversion.hpp"
+#include "Hash.hpp"
+#include "Ktx2.hpp"
 #include "Log.hpp"
+#include "MappedFile.hpp"
+#include "MeshOptimization.hpp"
+#include "TextureCache.hpp"
+#include "TextureStreamer.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 
-int NumComponents(int type);
-int CompSize(int comp);
-std::vector<float> ReadAccessorAsFloat(const tinygltf::Model& m, const tinygltf::Accessor& acc);
-std::vector<uint32_t> ReadAccessorAsUInt32(const tinygltf::Model& m, const tinygltf::Accessor& acc);
-Image ImageFromGlTFImage(const tinygltf::Image& image, const tinygltf::Sampler& sampler, bool srgb);
-
-Model::Model(std::filesystem::path p)
+// tinygltf copies every buffer into a std::vector, for big scenes that is the whole file duplicated in memory before the
+// upload even starts. Instead the .glb / .bin files get mapped and tinygltf only sees a placeholder for each buffer,
+// the accessors and images read straight from the mappings
+struct GltfData
 {
     tinygltf::Model gltf;
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-    bool ret = loader.LoadASCIIFromFile(&gltf, &err, &warn, p.string());
-    // Or LoadBinaryFromFile(&model, &err, &warn, "model.glb");
+    std::vector<std::shared_ptr<MappedFile>> files;  // shared with the texture decodes that still read from them
+    std::vector<std::filesystem::path> filePaths;  // indexed like files
+    std::vector<std::span<const uint8_t>> buffers;        // indexed like gltf.buffers
+    std::vector<std::span<const uint8_t>> encodedImages;  // indexed like gltf.images, empty if tinygltf already decoded it
+};
+
+// where a texture's encoded image lives, enough to load it again without the glTF
+struct TextureSource
+{
+    std::string file;  // relative to the model's directory
+    uint64_t offset;
+    uint64_t size;
+    SamplerConfig sampler;
+    bool srgb;
+};
+
+// A primitive decoded into memory of its own so it can be optimized, welding changes how many vertices it ends up with
+struct OptimizedPrimitive
+{
+    std::vector<uint8_t> vertices;
+    std::vector<uint32_t> indices;
+    size_t decodedVertexCount = 0;
+    VertexCacheStats before{0, 0};
+    VertexCacheStats after{0, 0};
+};
+
+struct Model::CookData
+{
+    // images embedded as data URIs only exist decoded, a cooked file can't point at them
+    bool cookable = true;
+    std::vector<std::string> sourceFiles;  // every file the glTF was loaded from, relative to the model's directory
+    std::vector<TextureSource> textures;
+    std::vector<std::array<int32_t, 4>> primitiveTextures;  // base color, specular tint, metallic roughness, emissive
+    Buffer stagingVertexBuffer;
+    Buffer stagingIndexBuffer;
+};
+
+// a glTF texture within one model, textures pointing at the same image with the same sampler are the same Image
+struct ModelTextureKey
+{
+    int image;
+    bool srgb;
+    SamplerConfig sampler;
 
-    if(!warn.empty())
+    bool operator==(const ModelTextureKey& other) const = default;
+};
+struct ModelTextureKeyHash
+{
+    std::size_t operator()(const ModelTextureKey& k) const
     {
-        Log::Warn("GLTF: {}", warn);
+        std::size_t result = 0;
+        hashCombine(result, k.image);
+        hashCombine(result, k.srgb);
+        hashCombine(result, k.sampler);
+        return result;
     }
-    if(!err.empty())
+};
+
+GltfData LoadGltf(const std::filesystem::path& path);
+std::optional<TextureSource> GetTextureSource(const GltfData& data, const std::filesystem::path& baseDir, int imageIndex, const SamplerConfig& sampler, bool srgb);
+int NumComponents(int type);
+int CompSize(int comp);
+AccessorView GetAccessorView(const GltfData& data, const tinygltf::Accessor& acc, uint32_t componentCount);
+PositionQuantization MeshQuantization(const GltfData& data, const tinygltf::Mesh& mesh);
+void DecodePrimitive(const GltfData& data, const tinygltf::Primitive& prim, VertexFormat format, const PositionQuantization& quantization, uint8_t* vertices, uint32_t* indices, const std::filesystem::path& p);
+void DecodeOptimizedPrimitive(const GltfData& data, const tinygltf::Primitive& prim, VertexFormat format, const PositionQuantization& quantization, OptimizedPrimitive& out, const std::filesystem::path& p);
+SamplerConfig SamplerFromGltf(const tinygltf::Sampler& sampler);
+int TextureImage(const tinygltf::Texture& texture);
+std::shared_ptr<Image> GetSharedTexture(const std::filesystem::path& baseDir, const TextureSource& source, const std::function<std::shared_ptr<Image>()>& create);
+std::shared_ptr<Image> ImageFromGlTFImage(const GltfData& data, int imageIndex, const SamplerConfig& sampler, bool srgb);
+std::shared_ptr<Image> DecodeTexture(std::span<const uint8_t> encoded, std::shared_ptr<const void> owner, const SamplerConfig& sampler, bool srgb, const std::string& name);
+std::shared_ptr<Image> CreateTexture(TextureStreamer::Request request);
+
+Model::Model(std::filesystem::path p, const std::filesystem::path& cacheDirectory, const ModelOptions& options) : m_options(options)
+{
+    std::error_code ec;
+    const auto absolutePath = std::filesystem::absolute(p, ec);
+    const auto cookKey      = std::format("{}|optimize={}|format={}", absolutePath.generic_string(), options.optimizeMeshes, static_cast<uint32_t>(options.vertexFormat));
+    const auto cookedPath   = cacheDirectory / std::format("{}_{:016x}.cooked", p.stem().string(), HashFNV1a(cookKey));
+
+    if(!LoadCooked(p, cookedPath))
     {
-        Log::Error("GLTF: {}", err);
+        CookData cook;
+        LoadFromGltf(p, cook);
+        if(cook.cookable)
+            WriteCooked(p, cookedPath, cook);
+        else
+            Log::Warn("{} has images embedded as data URIs, it can't be cooked", p.string());
     }
-    if(!ret)
+
+    auto nameVertex = p.filename().string() + "_vertex";
+    VK_SET_DEBUG_NAME(m_vertexBuffer.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, nameVertex.c_str());
+    auto nameIndex = p.filename().string() + "_index";
+    VK_SET_DEBUG_NAME(m_indexBuffer.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, nameIndex.c_str());
+}
+
+void Model::LoadFromGltf(const std::filesystem::path& p, CookData& cook)
+{
+    GltfData data               = LoadGltf(p);
+    const tinygltf::Model& gltf = data.gltf;
+    for(const auto& path : data.filePaths)
+        cook.sourceFiles.push_back(path.lexically_relative(p.parent_path()).generic_string());
+
+    // Every image is uploaded once per format and sampler, no matter how many materials use it. Images in files also go
+    // through the renderer's texture cache so other models using the same files share them.
+    // Also records where the image comes from for the cooked file
+    struct LoadedTexture
     {
-        Log::Error("Failed to load glTF");
-        abort();
-    }
+        std::shared_ptr<Image> image;
+        int32_t sourceIndex;
+    };
+    std::unordered_map<ModelTextureKey, LoadedTexture, ModelTextureKeyHash> loadedTextures;
+    auto loadTexture = [&](int textureIndex, bool srgb, int32_t& sourceIndex) -> std::shared_ptr<Image>
+    {
+        const auto& texture = gltf.textures[textureIndex];
+        const auto sampler  = SamplerFromGltf(gltf.samplers[texture.sampler]);
+        const int image     = TextureImage(texture);
+
+        const ModelTextureKey key{image, srgb, sampler};
+        if(auto it = loadedTextures.find(key); it != loadedTextures.end())
+        {
+            sourceIndex = it->second.sourceIndex;
+            return it->second.image;
+        }
+
+        auto create = [&]() { return ImageFromGlTFImage(data, image, sampler, srgb); };
+
+        LoadedTexture loaded{nullptr, -1};
+        auto source = GetTextureSource(data, p.parent_path(), image, sampler, srgb);
+        if(source)
+        {
+            loaded.image       = GetSharedTexture(p.parent_path(), *source, create);
+            loaded.sourceIndex = static_cast<int32_t>(cook.textures.size());
+            cook.textures.push_back(std::move(*source));
+        }
+        else
+        {
+            loaded.image  = create();
+            cook.cookable = false;
+        }
+        sourceIndex = loaded.sourceIndex;
+        return loadedTextures.emplace(key, std::move(loaded)).first->second.image;
+    };
 
 
-    // first pass: compute buffer sizes
+    // first pass: compute buffer sizes, per node like the second pass since every node gets its own copy of the mesh
     uint64_t totalVertices = 0;
     uint64_t totalIndices  = 0;
-    for(const auto& mesh : gltf.meshes)
+    size_t totalPrimitives = 0;
+    for(const auto& node : gltf.nodes)
     {
-        for(const auto& prim : mesh.primitives)
+        if(node.mesh == -1)
+            continue;
+        totalPrimitives += gltf.meshes[node.mesh].primitives.size();
+        for(const auto& prim : gltf.meshes[node.mesh].primitives)
         {
             if(prim.attributes.find("POSITION") == prim.attributes.end())
                 throw std::runtime_error("primitive without POSITION not supported");
@@ -61,18 +201,46 @@ Model::Model(std::filesystem::path p)
         }
     }
 
-    const uint64_t vertexBufferBytes = totalVertices * VERTEX_SIZE;
-    const uint64_t indexBufferBytes  = totalIndices * sizeof(uint32_t);
+    // kept alive in cook so the final data can be written to the cooked file
+    Buffer& stagingVertexBuffer = cook.stagingVertexBuffer;
+    Buffer& stagingIndexBuffer  = cook.stagingIndexBuffer;
+    auto allocateBuffers        = [&](uint64_t vertexBufferBytes, uint64_t indexBufferBytes)
+    {
+        stagingVertexBuffer.Allocate(vertexBufferBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+        stagingIndexBuffer.Allocate(indexBufferBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
 
-    Buffer stagingVertexBuffer(vertexBufferBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
-    Buffer stagingIndexBuffer(indexBufferBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+        m_vertexBuffer.Allocate(vertexBufferBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+        m_indexBuffer.Allocate(indexBufferBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+    };
 
-    m_vertexBuffer.Allocate(vertexBufferBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
-    m_indexBuffer.Allocate(indexBufferBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+    // optimized primitives only know their final size once they are done, the buffers get laid out after that
+    std::vector<OptimizedPrimitive> optimized(m_options.optimizeMeshes ? totalPrimitives : 0);
+    if(!m_options.optimizeMeshes)
+        allocateBuffers(totalVertices * GetVertexSize(), totalIndices * sizeof(uint32_t));
 
     // second pass: read data
+    // Every primitive owns the range of the staging buffers the first pass sizes give it (or its OptimizedPrimitive), so the
+    // geometry gets decoded on the thread pool while this thread goes on with the materials (which only create the images,
+    // the texture streamer decodes and uploads them in the background)
     uint64_t vertexByteCursor = 0;
     uint64_t indexByteCursor  = 0;
+    size_t primitiveIndex     = 0;
+
+    ThreadPool* threadPool = VulkanContext::GetThreadPool();
+    std::vector<std::future<void>> decodes;
+    // the tasks reference locals, so even if something throws nothing can leave before they are done
+    struct DecodeGuard
+    {
+        std::vector<std::future<void>>& decodes;
+        ~DecodeGuard()
+        {
+            for(auto& decode : decodes)
+            {
+                if(decode.valid())
+                    decode.wait();
+            }
+        }
+    } decodeGuard{decodes};
 
     m_meshes.reserve(gltf.meshes.size());
 
@@ -173,9 +341,12 @@ Model::Model(std::filesystem::path p)
 
         const auto& mesh = gltf.meshes[node.mesh];
         outMesh.primitives.reserve(mesh.primitives.size());
+        if(m_options.vertexFormat == VertexFormat::COMPACT)
+            outMesh.quantization = MeshQuantization(data, mesh);
         for(const auto& prim : mesh.primitives)
         {
             Primitive outPrim;
+            std::array<int32_t, 4> textureSources = {-1, -1, -1, -1};
             if(prim.material >= 0)
             {
                 const tinygltf::Material& gm = gltf.materials[prim.material];
@@ -186,12 +357,9 @@ Model::Model(std::filesystem::path p)
                 }
                 if(gm.values.find("baseColorTexture") != gm.values.end())
                 {
-                    const auto& tex     = gm.pbrMetallicRoughness.baseColorTexture;
-                    const auto& texture = gltf.textures[tex.index];
-                    const auto& img     = gltf.images[texture.source];
-                    const auto& sampler = gltf.samplers[texture.sampler];
+                    const auto& tex = gm.pbrMetallicRoughness.baseColorTexture;
 
-                    outPrim.material.baseColorTexture = ImageFromGlTFImage(img, sampler, true);
+                    outPrim.material.baseColorTexture = loadTexture(tex.index, true, textureSources[0]);
                 }
                 if(gm.values.find("metallicFactor") != gm.values.end())
                 {
@@ -207,23 +375,17 @@ Model::Model(std::filesystem::path p)
 
                 if(gm.values.find("metallicRoughnessTexture") != gm.values.end())
                 {
-                    const auto& tex     = gm.pbrMetallicRoughness.metallicRoughnessTexture;
-                    const auto& texture = gltf.textures[tex.index];
-                    const auto& img     = gltf.images[texture.source];
-                    const auto& sampler = gltf.samplers[texture.sampler];
+                    const auto& tex = gm.pbrMetallicRoughness.metallicRoughnessTexture;
 
-                    outPrim.material.metallicRoughnessTexture = ImageFromGlTFImage(img, sampler, false);
+                    outPrim.material.metallicRoughnessTexture = loadTexture(tex.index, false, textureSources[2]);
                 }
 
                 outPrim.material.emissiveColor = glm::vec3{gm.emissiveFactor[0], gm.emissiveFactor[1], gm.emissiveFactor[2]};
                 if(gm.values.find("emissiveTexture") != gm.values.end())
                 {
-                    const auto& tex     = gm.emissiveTexture;
-                    const auto& texture = gltf.textures[tex.index];
-                    const auto& img     = gltf.images[texture.source];
-                    const auto& sampler = gltf.samplers[texture.sampler];
+                    const auto& tex = gm.emissiveTexture;
 
-                    outPrim.material.emissiveColorTexture = ImageFromGlTFImage(img, sampler, true);
+                    outPrim.material.emissiveColorTexture = loadTexture(tex.index, true, textureSources[3]);
                 }
 
                 if(gm.extensions.find("KHR_materials_emissive_strength") != gm.extensions.end())
@@ -273,269 +435,928 @@ Model::Model(std::filesystem::path p)
                         auto ext             = extVal.Get("specularColorTexture");
                         const auto& texIndex = ext.Get("index").GetNumberAsInt();
                         assert(texIndex >= 0);
-                        const auto& texture = gltf.textures[texIndex];
-                        const auto& img     = gltf.images[texture.source];
-                        const auto& sampler = gltf.samplers[texture.sampler];
 
-                        outPrim.material.specularTintTexture = ImageFromGlTFImage(img, sampler, true);
+                        outPrim.material.specularTintTexture = loadTexture(texIndex, true, textureSources[1]);
                     }
                 }
             }
 
-            // read attributes
             const tinygltf::Accessor& posAcc = gltf.accessors[prim.attributes.at("POSITION")];
+            outPrim.vertexBufferOffset        = vertexByteCursor;
+            outPrim.vertexBufferSize          = posAcc.count * GetVertexSize();
+            vertexByteCursor                 += outPrim.vertexBufferSize;
 
-            auto positions = ReadAccessorAsFloat(gltf, posAcc);  // length = posAcc.count * 3
-
-            std::vector<float> normals;
-            if(prim.attributes.find("NORMAL") != prim.attributes.end())
+            if(prim.indices >= 0)
             {
-                normals = ReadAccessorAsFloat(gltf, gltf.accessors[prim.attributes.at("NORMAL")]);
+                const tinygltf::Accessor& idxAcc = gltf.accessors[prim.indices];
+                outPrim.indexBufferOffset        = indexByteCursor;
+                outPrim.indexBufferSize          = idxAcc.count * sizeof(uint32_t);
+                indexByteCursor                 += outPrim.indexBufferSize;
             }
             else
             {
-                // TODO: calculate normals if not present
-                Log::Error("No vertex normals found for {}, insterting 0s", p.string());
-                normals.assign(posAcc.count * 3, 0.0f);
+                outPrim.indexBufferOffset = 0;
+                outPrim.indexBufferSize   = 0;
             }
 
-            std::vector<float> uvs;
-            if(prim.attributes.find("TEXCOORD_0") != prim.attributes.end())
+            std::function<void()> decode;
+            if(m_options.optimizeMeshes)
             {
-                uvs = ReadAccessorAsFloat(gltf, gltf.accessors[prim.attributes.at("TEXCOORD_0")]);
+                decode = [&data, &prim, &p, format = m_options.vertexFormat, quantization = outMesh.quantization, &out = optimized[primitiveIndex]]()
+                {
+                    DecodeOptimizedPrimitive(data, prim, format, quantization, out, p);
+                };
             }
             else
             {
-                Log::Error("No vertex UVs found for {}, inserting 0s", p.string());
-                uvs.assign(posAcc.count * 2, 0.0f);
+                uint8_t* vertices = static_cast<uint8_t*>(stagingVertexBuffer.GetMappedMemory());
+                uint8_t* indices  = static_cast<uint8_t*>(stagingIndexBuffer.GetMappedMemory());
+                assert(vertices && outPrim.vertexBufferOffset + outPrim.vertexBufferSize <= stagingVertexBuffer.GetSize());
+                assert(outPrim.indexBufferSize == 0 || (indices && outPrim.indexBufferOffset + outPrim.indexBufferSize <= stagingIndexBuffer.GetSize()));
+                decode = [&data, &prim, &p, format = m_options.vertexFormat, quantization = outMesh.quantization, vertices = vertices + outPrim.vertexBufferOffset, indices = reinterpret_cast<uint32_t*>(indices + outPrim.indexBufferOffset)]()
+                {
+                    DecodePrimitive(data, prim, format, quantization, vertices, indices, p);
+                };
             }
+            if(threadPool)
+                decodes.push_back(threadPool->Submit(std::move(decode)));
+            else
+                decode();
 
-            // pack vertices into contiguous CPU buffer for a primitive then upload
-            const uint32_t vertCount = static_cast<uint32_t>(posAcc.count);
-            std::vector<float> packed;
-            packed.reserve(vertCount * VERTEX_SIZE);
-            for(uint32_t i = 0; i < vertCount; ++i)
-            {
-                packed.push_back(positions[i * 3 + 0]);
-                packed.push_back(positions[i * 3 + 1]);
-                packed.push_back(positions[i * 3 + 2]);
-
-                packed.push_back(normals[i * 3 + 0]);
-                packed.push_back(normals[i * 3 + 1]);
-                packed.push_back(normals[i * 3 + 2]);
-
-                packed.push_back(uvs[i * 2 + 0]);
-                packed.push_back(uvs[i * 2 + 1]);
-            }
+            outMesh.primitives.push_back(std::move(outPrim));
+            cook.primitiveTextures.push_back(textureSources);
+            ++primitiveIndex;
+        }
+        m_meshes.push_back(std::move(outMesh));
+    }
 
-            uint64_t vbSize = uint64_t(packed.size() * sizeof(float));
-            stagingVertexBuffer.Fill(packed.data(), vbSize, vertexByteCursor);
-            outPrim.vertexBufferOffset  = vertexByteCursor;
-            outPrim.vertexBufferSize    = vbSize;
-            vertexByteCursor           += vbSize;
+    // rethrows what the decodes threw
+    for(auto& decode : decodes)
+        decode.get();
 
-            if(prim.indices >= 0)
+    if(m_options.optimizeMeshes)
+    {
+        // the primitives are in the same order as optimized, their final ranges follow each other like without optimizing
+        VertexCacheStats before{0, 0};
+        VertexCacheStats after{0, 0};
+        size_t verticesBefore = 0;
+        size_t verticesAfter  = 0;
+        uint64_t vertexBytes  = 0;
+        uint64_t indexBytes   = 0;
+        size_t index          = 0;
+        for(auto& mesh : m_meshes)
+        {
+            for(auto& prim : mesh.primitives)
             {
-                const tinygltf::Accessor& idxAcc = gltf.accessors[prim.indices];
-                auto idxs                        = ReadAccessorAsUInt32(gltf, idxAcc);
-                uint64_t ibSize                  = uint64_t(idxs.size() * sizeof(uint32_t));
-                stagingIndexBuffer.Fill(idxs.data(), ibSize, indexByteCursor);
-                outPrim.indexBufferOffset  = indexByteCursor;
-                outPrim.indexBufferSize    = ibSize;
-                indexByteCursor           += ibSize;
+                const OptimizedPrimitive& opt = optimized[index++];
+                prim.vertexBufferOffset       = vertexBytes;
+                prim.vertexBufferSize         = opt.vertices.size();
+                prim.indexBufferOffset        = opt.indices.empty() ? 0 : indexBytes;
+                prim.indexBufferSize          = opt.indices.size() * sizeof(uint32_t);
+                vertexBytes                  += prim.vertexBufferSize;
+                indexBytes                   += prim.indexBufferSize;
+
+                before.misses    += opt.before.misses;
+                before.triangles += opt.before.triangles;
+                after.misses     += opt.after.misses;
+                after.triangles  += opt.after.triangles;
+                verticesBefore   += opt.decodedVertexCount;
+                verticesAfter    += opt.vertices.size() / GetVertexSize();
             }
-            else
+        }
+
+        allocateBuffers(vertexBytes, indexBytes);
+        uint8_t* vertices = static_cast<uint8_t*>(stagingVertexBuffer.GetMappedMemory());
+        uint8_t* indices  = static_cast<uint8_t*>(stagingIndexBuffer.GetMappedMemory());
+        index             = 0;
+        for(const auto& mesh : m_meshes)
+        {
+            for(const auto& prim : mesh.primitives)
             {
-                outPrim.indexBufferOffset = 0;
-                outPrim.indexBufferSize   = 0;
+                const OptimizedPrimitive& opt = optimized[index++];
+                std::memcpy(vertices + prim.vertexBufferOffset, opt.vertices.data(), opt.vertices.size());
+                if(!opt.indices.empty())
+                    std::memcpy(indices + prim.indexBufferOffset, opt.indices.data(), prim.indexBufferSize);
             }
-            outMesh.primitives.push_back(std::move(outPrim));
         }
-        m_meshes.push_back(std::move(outMesh));
+
+        if(before.triangles > 0)
+        {
+            Log::Info("Optimized {}: ACMR {:.3f} -> {:.3f}, {} -> {} vertices", p.filename().string(), static_cast<double>(before.misses) / before.triangles, static_cast<double>(after.misses) / after.triangles, verticesBefore, verticesAfter);
+        }
     }
 
     stagingVertexBuffer.Copy(&m_vertexBuffer);
     stagingIndexBuffer.Copy(&m_indexBuffer);
+}
 
-    auto nameVertex = p.filename().string() + "_vertex";
-    VK_SET_DEBUG_NAME(m_vertexBuffer.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, nameVertex.c_str());
-    auto nameIndex = p.filename().string() + "_index";
-    VK_SET_DEBUG_NAME(m_indexBuffer.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, nameIndex.c_str());
+// Bounds of the positions of every primitive of mesh, glTF requires float POSITION accessors to have min and max.
+// Anything else (e.g. KHR_mesh_quantization) gets decoded to find them
+PositionQuantization MeshQuantization(const GltfData& data, const tinygltf::Mesh& mesh)
+{
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+    for(const auto& prim : mesh.primitives)
+    {
+        const tinygltf::Accessor& acc = data.gltf.accessors[prim.attributes.at("POSITION")];
+        if(acc.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT && acc.minValues.size() == 3 && acc.maxValues.size() == 3)
+        {
+            boundsMin = glm::min(boundsMin, glm::vec3(acc.minValues[0], acc.minValues[1], acc.minValues[2]));
+            boundsMax = glm::max(boundsMax, glm::vec3(acc.maxValues[0], acc.maxValues[1], acc.maxValues[2]));
+            continue;
+        }
+
+        const AccessorView view = GetAccessorView(data, acc, 3);
+        std::vector<glm::vec3> positions(view.count);
+        ConvertToFloat(view, reinterpret_cast<uint8_t*>(positions.data()), sizeof(glm::vec3));
+        for(const glm::vec3& position : positions)
+        {
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+    }
+    if(boundsMin.x > boundsMax.x)
+        return {};
+    return QuantizationFromBounds(boundsMin, boundsMax);
 }
 
-int NumComponents(int type)
+// Writes the interleaved vertices of prim in format to vertices and its indices to indices, room for the POSITION and index
+// accessor counts has to be there. Runs on the thread pool, the memory may be write combined staging
+void DecodePrimitive(const GltfData& data, const tinygltf::Primitive& prim, VertexFormat format, const PositionQuantization& quantization, uint8_t* vertices, uint32_t* indices, const std::filesystem::path& p)
 {
-    return tinygltf::GetNumComponentsInType(type);
+    const tinygltf::Model& gltf = data.gltf;
+
+    const tinygltf::Accessor& posAcc = gltf.accessors[prim.attributes.at("POSITION")];
+    const size_t vertCount           = posAcc.count;
+
+    auto getAttribute = [&](const char* name, uint32_t componentCount) -> std::optional<AccessorView>
+    {
+        auto it = prim.attributes.find(name);
+        if(it == prim.attributes.end())
+            return std::nullopt;
+
+        AccessorView view = GetAccessorView(data, gltf.accessors[it->second], componentCount);
+        if(view.count != vertCount)
+            Log::Warn("{} of {} has {} elements instead of {}", name, p.string(), view.count, vertCount);
+        view.count = std::min(view.count, vertCount);
+        return view;
+    };
+
+    const auto positions = getAttribute("POSITION", 3);
+    const auto normals   = getAttribute("NORMAL", 3);
+    if(!normals)
+    {
+        // TODO: calculate normals if not present
+        Log::Error("No vertex normals found for {}, insterting 0s", p.string());
+    }
+    const auto uvs = getAttribute("TEXCOORD_0", 2);
+    if(!uvs)
+        Log::Error("No vertex UVs found for {}, inserting 0s", p.string());
+
+    // The staging memory may be write combined, so rather than each attribute scattering partial writes over it the vertices
+    // get assembled a block at a time in a small buffer that stays in cache (and compressed there) and copied out whole
+    constexpr size_t BLOCK_VERTICES = 128;
+    const size_t vertexSize         = GetVertexSize(format);
+    alignas(16) uint8_t block[BLOCK_VERTICES * Model::VERTEX_SIZE];
+
+    // missing attributes and elements past the end of a short accessor are 0
+    auto convertAttribute = [&](const std::optional<AccessorView>& attribute, size_t first, size_t count, size_t offset, size_t size)
+    {
+        size_t converted = 0;
+        if(attribute && first < attribute->count)
+        {
+            AccessorView part  = *attribute;
+            part.data         += first * part.stride;
+            part.count         = std::min(count, attribute->count - first);
+            ConvertToFloat(part, block + offset, Model::VERTEX_SIZE);
+            converted = part.count;
+        }
+        for(size_t i = converted; i < count; ++i)
+            std::memset(block + i * Model::VERTEX_SIZE + offset, 0, size);
+    };
+
+    for(size_t first = 0; first < vertCount; first += BLOCK_VERTICES)
+    {
+        const size_t count = std::min(BLOCK_VERTICES, vertCount - first);
+        convertAttribute(positions, first, count, 0, 3 * sizeof(float));
+        convertAttribute(normals, first, count, 3 * sizeof(float), 3 * sizeof(float));
+        convertAttribute(uvs, first, count, 6 * sizeof(float), 2 * sizeof(float));
+        if(format == VertexFormat::COMPACT)
+            CompressVertices(block, count, quantization, block);
+        std::memcpy(vertices + first * vertexSize, block, count * vertexSize);
+    }
+
+    // indices are written in order anyway, they go straight to staging
+    if(prim.indices >= 0)
+    {
+        const AccessorView view = GetAccessorView(data, gltf.accessors[prim.indices], 1);
+        ConvertToUInt32(view, indices);
+    }
 }
-int CompSize(int comp)
+
+// Decodes prim into out and optimizes it. Only indexed triangle lists get optimized, the rest is kept as it is. The optimizer
+// needs float positions, so the vertices only get compressed to format at the end
+void DecodeOptimizedPrimitive(const GltfData& data, const tinygltf::Primitive& prim, VertexFormat format, const PositionQuantization& quantization, OptimizedPrimitive& out, const std::filesystem::path& p)
 {
-    return tinygltf::GetComponentSizeInBytes(comp);
+    const tinygltf::Model& gltf = data.gltf;
+    const size_t vertexCount    = gltf.accessors[prim.attributes.at("POSITION")].count;
+    const size_t indexCount     = prim.indices >= 0 ? gltf.accessors[prim.indices].count : 0;
+
+    out.vertices.resize(vertexCount * Model::VERTEX_SIZE);
+    out.indices.resize(indexCount);
+    out.decodedVertexCount = vertexCount;
+    DecodePrimitive(data, prim, VertexFormat::FULL, {}, out.vertices.data(), out.indices.data(), p);
+
+    auto compress = [&]()
+    {
+        if(format == VertexFormat::FULL)
+            return;
+        const size_t count = out.vertices.size() / Model::VERTEX_SIZE;
+        CompressVertices(out.vertices.data(), count, quantization, out.vertices.data());
+        out.vertices.resize(count * GetVertexSize(format));
+    };
+
+    if(out.indices.empty() || (prim.mode != TINYGLTF_MODE_TRIANGLES && prim.mode != -1))
+        return compress();
+    if(std::ranges::any_of(out.indices, [&](uint32_t index) { return index >= vertexCount; }))
+    {
+        Log::Warn("{} has indices past the end of its vertices, the primitive isn't optimized", p.string());
+        return compress();
+    }
+
+    // position is the first attribute of the vertex
+    out.before = SimulateVertexCache(out.indices);
+    WeldVertices(out.vertices, Model::VERTEX_SIZE, out.indices);
+    OptimizeTriangleOrder(out.indices, out.vertices.size() / Model::VERTEX_SIZE, out.vertices.data(), Model::VERTEX_SIZE);
+    OptimizeVertexFetch(out.vertices, Model::VERTEX_SIZE, out.indices);
+    if(format != VertexFormat::FULL)
+    {
+        // vertices that only differed below the precision of format are the same now. Welding keeps the first of them, so
+        // the fetch order stays sequential
+        compress();
+        WeldVertices(out.vertices, GetVertexSize(format), out.indices);
+    }
+    out.after = SimulateVertexCache(out.indices);
 }
 
-std::vector<float> ReadAccessorAsFloat(const tinygltf::Model& m, const tinygltf::Accessor& acc)
+// Cooked file layout, all sections follow each other:
+//      CookedHeader
+//      CookedMesh[meshCount]
+//      CookedPrimitive[primitiveCount]
+//      CookedTexture[textureCount]
+//      CookedSourceFile[sourceFileCount]
+//      char[stringBytes]                   texture and source file names
+//      padding to 16 bytes
+//      vertex data[vertexBufferBytes]      exactly what ends up in the vertex buffer
+//      index data[indexBufferBytes]
+// Bump COOKED_VERSION whenever any of it (or the vertex layout) changes
+namespace
 {
-    if(acc.sparse.count > 0)
-        throw std::runtime_error("sparse accessors not supported");
+constexpr uint32_t COOKED_MAGIC   = 0x4B4F4F43;  // "COOK"
+constexpr uint32_t COOKED_VERSION = 3;
 
-    const tinygltf::BufferView& bv = m.bufferViews[acc.bufferView];
-    const tinygltf::Buffer& buf    = m.buffers[bv.buffer];
-    const unsigned char* base      = buf.data.data() + bv.byteOffset + acc.byteOffset;
+struct CookedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t hasCamera;
+    uint64_t vertexBufferBytes;
+    uint64_t indexBufferBytes;
+    uint32_t meshCount;
+    uint32_t primitiveCount;
+    uint32_t textureCount;
+    uint32_t sourceFileCount;
+    uint32_t stringBytes;
+    uint32_t padding;
+    Camera camera;
+};
+
+struct CookedMesh
+{
+    glm::mat4 transform;
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+    uint32_t primitiveCount;
+    uint32_t padding;
+};
+
+struct CookedPrimitive
+{
+    glm::vec4 baseColor;
+    glm::vec3 emissiveColor;
+    float emissiveStrength;
+    glm::vec3 specularTint;
+    float metallicness;
+    float roughness;
+    float ior;
+    float transmission;
+    int32_t textures[4];  // index into the texture table or -1, same order as CookData::primitiveTextures
+    uint32_t padding;
+    uint64_t vertexBufferOffset;
+    uint64_t vertexBufferSize;
+    uint64_t indexBufferOffset;
+    uint64_t indexBufferSize;
+};
+
+struct CookedTexture
+{
+    uint32_t fileOffset;  // into the string section
+    uint32_t fileLength;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t minFilter;
+    uint32_t magFilter;
+    uint32_t mipFilter;
+    uint32_t addressMode;
+    uint32_t srgb;
+    uint32_t padding;
+};
+
+// the .gltf / .glb and every buffer and image file it references, the cooked file is stale once any of them changed
+struct CookedSourceFile
+{
+    uint32_t fileOffset;  // into the string section
+    uint32_t fileLength;
+    uint64_t size;
+    int64_t writeTime;
+};
 
-    const int compSize  = CompSize(acc.componentType);
-    const int ncomp     = NumComponents(acc.type);
-    const size_t stride = bv.byteStride ? bv.byteStride : (compSize * ncomp);
+static_assert(std::is_trivially_copyable_v<CookedHeader> && std::is_trivially_copyable_v<CookedMesh> && std::is_trivially_copyable_v<CookedPrimitive> && std::is_trivially_copyable_v<CookedTexture> && std::is_trivially_copyable_v<CookedSourceFile>);
 
-    std::vector<float> out;
-    out.reserve(acc.count * ncomp);
+constexpr uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
 
-    for(size_t i = 0; i < acc.count; ++i)
+bool GetSourceStamp(const std::filesystem::path& p, uint64_t& size, int64_t& writeTime)
+{
+    std::error_code ec;
+    size = std::filesystem::file_size(p, ec);
+    if(ec)
+        return false;
+    writeTime = std::filesystem::last_write_time(p, ec).time_since_epoch().count();
+    return !ec;
+}
+
+template<typename T>
+std::vector<T> ReadSection(std::span<const uint8_t> bytes, uint64_t& offset, uint64_t count)
+{
+    std::vector<T> res(count);
+    std::memcpy(res.data(), bytes.data() + offset, count * sizeof(T));
+    offset += count * sizeof(T);
+    return res;
+}
+}
+
+bool Model::LoadCooked(const std::filesystem::path& p, const std::filesystem::path& cookedPath)
+{
+    MappedFile file(cookedPath);
+    if(!file.IsOpen())
+        return false;
+
+    const auto bytes = file.GetData();
+    CookedHeader header{};
+    if(bytes.size() < sizeof(CookedHeader))
     {
-        const unsigned char* elem = base + i * stride;
-        for(int c = 0; c < ncomp; ++c)
+        Log::Warn("Cooked model {} is truncated, cooking it again", cookedPath.string());
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(CookedHeader));
+    if(header.magic != COOKED_MAGIC || header.version != COOKED_VERSION || header.vertexSize != GetVertexSize())
+    {
+        Log::Info("Cooked model {} is from an older version, cooking it again", cookedPath.string());
+        return false;
+    }
+
+    uint64_t offset          = sizeof(CookedHeader);
+    const uint64_t dataStart = AlignUp(offset + header.meshCount * sizeof(CookedMesh) + header.primitiveCount * sizeof(CookedPrimitive) + header.textureCount * sizeof(CookedTexture) + header.sourceFileCount * sizeof(CookedSourceFile) + header.stringBytes, 16);
+    if(dataStart + header.vertexBufferBytes + header.indexBufferBytes > bytes.size())
+    {
+        Log::Warn("Cooked model {} is truncated, cooking it again", cookedPath.string());
+        return false;
+    }
+
+    const auto meshes     = ReadSection<CookedMesh>(bytes, offset, header.meshCount);
+    const auto primitives = ReadSection<CookedPrimitive>(bytes, offset, header.primitiveCount);
+    const auto textures   = ReadSection<CookedTexture>(bytes, offset, header.textureCount);
+    const auto sources    = ReadSection<CookedSourceFile>(bytes, offset, header.sourceFileCount);
+    const std::string_view strings(reinterpret_cast<const char*>(bytes.data() + offset), header.stringBytes);
+
+    const auto baseDir = p.parent_path();
+    for(const auto& source : sources)
+    {
+        if(uint64_t(source.fileOffset) + source.fileLength > strings.size())
+        {
+            Log::Warn("Cooked model {} has an invalid source file name, cooking it again", cookedPath.string());
+            return false;
+        }
+        const std::string_view name = strings.substr(source.fileOffset, source.fileLength);
+
+        uint64_t size     = 0;
+        int64_t writeTime = 0;
+        if(!GetSourceStamp(baseDir / std::filesystem::path(std::u8string(name.begin(), name.end())), size, writeTime) || size != source.size || writeTime != source.writeTime)
+        {
+            Log::Info("{} changed since {} was cooked, cooking it again", name, p.string());
+            return false;
+        }
+    }
+
+    // textures are decoded from the files the glTF pointed to, a missing one means the cooked file is stale
+    std::unordered_map<std::string_view, std::shared_ptr<MappedFile>> textureFiles;
+    std::vector<std::shared_ptr<Image>> loadedTextures(textures.size());
+    auto loadTexture = [&](int32_t index) -> std::shared_ptr<Image>
+    {
+        if(index < 0)
+            return nullptr;
+        if(static_cast<uint32_t>(index) >= textures.size())
+            throw std::runtime_error("invalid texture index in cooked model");
+        if(loadedTextures[index])
+            return loadedTextures[index];
+
+        const CookedTexture& texture = textures[index];
+        if(uint64_t(texture.fileOffset) + texture.fileLength > strings.size())
+            throw std::runtime_error("invalid texture file name in cooked model");
+        const std::string_view name = strings.substr(texture.fileOffset, texture.fileLength);
+
+        auto it = textureFiles.find(name);
+        if(it == textureFiles.end())
+            it = textureFiles.emplace(name, std::make_shared<MappedFile>(baseDir / std::filesystem::path(std::u8string(name.begin(), name.end())))).first;
+        const auto fileData = it->second->GetData();
+        if(texture.offset + texture.size > fileData.size())
+            throw std::runtime_error(std::format("texture source {} of the cooked model changed", name));
+
+        TextureSource source{
+            .file    = std::string(name),
+            .offset  = texture.offset,
+            .size    = texture.size,
+            .sampler = {},
+            .srgb    = texture.srgb != 0,
+        };
+        source.sampler.minFilter   = static_cast<VkFilter>(texture.minFilter);
+        source.sampler.magFilter   = static_cast<VkFilter>(texture.magFilter);
+        source.sampler.mipFilter   = static_cast<VkSamplerMipmapMode>(texture.mipFilter);
+        source.sampler.addressMode = static_cast<VkSamplerAddressMode>(texture.addressMode);
+
+        loadedTextures[index] = GetSharedTexture(baseDir, source, [&]() { return DecodeTexture(fileData.subspan(source.offset, source.size), it->second, source.sampler, source.srgb, source.file); });
+        return loadedTextures[index];
+    };
+
+    std::vector<Mesh> loadedMeshes;
+    try
+    {
+        loadedMeshes.reserve(meshes.size());
+        uint32_t primitiveIndex = 0;
+        for(const auto& mesh : meshes)
         {
-            const unsigned char* compPtr = elem + c * compSize;
-            float v                      = 0.0f;
-            switch(acc.componentType)
+            if(primitiveIndex + mesh.primitiveCount > primitives.size())
+                throw std::runtime_error("invalid primitive count in cooked model");
+
+            Mesh outMesh{};
+            outMesh.transform           = mesh.transform;
+            outMesh.quantization.offset = mesh.positionOffset;
+            outMesh.quantization.scale  = mesh.positionScale;
+            outMesh.primitives.reserve(mesh.primitiveCount);
+            for(uint32_t i = 0; i < mesh.primitiveCount; ++i)
             {
-            case TINYGLTF_COMPONENT_TYPE_FLOAT:
-                {
-                    float tmp;
-                    std::memcpy(&tmp, compPtr, sizeof(float));
-                    v = tmp;
-                    break;
-                }
-            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-                {
-                    uint8_t tmp;
-                    std::memcpy(&tmp, compPtr, sizeof(uint8_t));
-                    if(acc.normalized)
-                        v = tmp / 255.0f;
-                    else
-                        v = float(tmp);
-                    break;
-                }
-            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-                {
-                    uint16_t tmp;
-                    std::memcpy(&tmp, compPtr, sizeof(uint16_t));
-                    if(acc.normalized)
-                        v = tmp / 65535.0f;
-                    else
-                        v = float(tmp);
-                    break;
-                }
-            case TINYGLTF_COMPONENT_TYPE_SHORT:
-                {
-                    int16_t tmp;
-                    std::memcpy(&tmp, compPtr, sizeof(int16_t));
-                    if(acc.normalized)
-                        v = std::max(-1.0f, float(tmp) / 32767.0f);
-                    else
-                        v = float(tmp);
-                    break;
-                }
-            case TINYGLTF_COMPONENT_TYPE_BYTE:
-                {
-                    int8_t tmp;
-                    std::memcpy(&tmp, compPtr, sizeof(int8_t));
-                    if(acc.normalized)
-                        v = std::max(-1.0f, float(tmp) / 127.0f);
-                    else
-                        v = float(tmp);
-                    break;
-                }
-            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-                {
-                    uint32_t tmp;
-                    std::memcpy(&tmp, compPtr, sizeof(uint32_t));
-                    v = float(tmp);
-                    break;
-                }
-            default:
-                throw std::runtime_error("unsupported component type in ReadAccessorAsFloat");
+                const CookedPrimitive& prim = primitives[primitiveIndex++];
+                if(prim.vertexBufferOffset + prim.vertexBufferSize > header.vertexBufferBytes || prim.indexBufferOffset + prim.indexBufferSize > header.indexBufferBytes)
+                    throw std::runtime_error("primitive out of the bounds of the cooked buffers");
+
+                Primitive outPrim;
+                outPrim.material.baseColor                = prim.baseColor;
+                outPrim.material.metallicness             = prim.metallicness;
+                outPrim.material.roughness                = prim.roughness;
+                outPrim.material.ior                      = prim.ior;
+                outPrim.material.emissiveColor            = prim.emissiveColor;
+                outPrim.material.emissiveStrength         = prim.emissiveStrength;
+                outPrim.material.transmission             = prim.transmission;
+                outPrim.material.specularTint             = prim.specularTint;
+                outPrim.material.baseColorTexture         = loadTexture(prim.textures[0]);
+                outPrim.material.specularTintTexture      = loadTexture(prim.textures[1]);
+                outPrim.material.metallicRoughnessTexture = loadTexture(prim.textures[2]);
+                outPrim.material.emissiveColorTexture     = loadTexture(prim.textures[3]);
+                outPrim.vertexBufferOffset                = prim.vertexBufferOffset;
+                outPrim.vertexBufferSize                  = prim.vertexBufferSize;
+                outPrim.indexBufferOffset                 = prim.indexBufferOffset;
+                outPrim.indexBufferSize                   = prim.indexBufferSize;
+                outMesh.primitives.push_back(std::move(outPrim));
             }
-            out.push_back(v);
+            loadedMeshes.push_back(std::move(outMesh));
         }
     }
-    return out;
+    catch(const std::runtime_error& e)
+    {
+        Log::Warn("Cooked model {} is unusable ({}), cooking it again", cookedPath.string(), e.what());
+        return false;
+    }
+
+    m_meshes = std::move(loadedMeshes);
+    if(header.hasCamera)
+        m_camera = header.camera;
+
+    // the interleaved data is final already, it only has to be copied into staging
+    Buffer stagingVertexBuffer(header.vertexBufferBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+    Buffer stagingIndexBuffer(header.indexBufferBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+    stagingVertexBuffer.Fill(bytes.data() + dataStart, header.vertexBufferBytes);
+    stagingIndexBuffer.Fill(bytes.data() + dataStart + header.vertexBufferBytes, header.indexBufferBytes);
+
+    m_vertexBuffer.Allocate(header.vertexBufferBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+    m_indexBuffer.Allocate(header.indexBufferBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+    stagingVertexBuffer.Copy(&m_vertexBuffer);
+    stagingIndexBuffer.Copy(&m_indexBuffer);
+    return true;
 }
 
-std::vector<uint32_t> ReadAccessorAsUInt32(const tinygltf::Model& m, const tinygltf::Accessor& acc)
+void Model::WriteCooked(const std::filesystem::path& p, const std::filesystem::path& cookedPath, CookData& cook)
 {
-    if(acc.sparse.count > 0)
-        throw std::runtime_error("sparse accessors not supported");
-    const tinygltf::BufferView& bv = m.bufferViews[acc.bufferView];
-    const tinygltf::Buffer& buf    = m.buffers[bv.buffer];
-    const unsigned char* base      = buf.data.data() + bv.byteOffset + acc.byteOffset;
-
-    const int compSize = CompSize(acc.componentType);
-    const int ncomp    = NumComponents(acc.type);
-    if(ncomp != 1)
-        throw std::runtime_error("index accessor type must be scalar");
-    const size_t stride = bv.byteStride ? bv.byteStride : compSize;
-
-    std::vector<uint32_t> out;
-    out.reserve(acc.count);
-    for(size_t i = 0; i < acc.count; ++i)
-    {
-        const unsigned char* compPtr = base + i * stride;
-        uint32_t v                   = 0;
-        switch(acc.componentType)
+    CookedHeader header{};
+    header.magic      = COOKED_MAGIC;
+    header.version    = COOKED_VERSION;
+    header.vertexSize = GetVertexSize();
+    header.vertexBufferBytes = cook.stagingVertexBuffer.GetSize();
+    header.indexBufferBytes  = cook.stagingIndexBuffer.GetSize();
+    header.hasCamera         = m_camera.has_value();
+    if(m_camera)
+        header.camera = *m_camera;
+
+    std::vector<CookedMesh> meshes;
+    std::vector<CookedPrimitive> primitives;
+    meshes.reserve(m_meshes.size());
+    for(const auto& mesh : m_meshes)
+    {
+        meshes.push_back({
+            .transform      = mesh.transform,
+            .positionOffset = mesh.quantization.offset,
+            .positionScale  = mesh.quantization.scale,
+            .primitiveCount = static_cast<uint32_t>(mesh.primitives.size()),
+            .padding        = 0,
+        });
+        for(const auto& prim : mesh.primitives)
+        {
+            const auto& textureSources = cook.primitiveTextures[primitives.size()];
+
+            CookedPrimitive& outPrim   = primitives.emplace_back();
+            outPrim.baseColor          = prim.material.baseColor;
+            outPrim.emissiveColor      = prim.material.emissiveColor;
+            outPrim.emissiveStrength   = prim.material.emissiveStrength;
+            outPrim.specularTint       = prim.material.specularTint;
+            outPrim.metallicness       = prim.material.metallicness;
+            outPrim.roughness          = prim.material.roughness;
+            outPrim.ior                = prim.material.ior;
+            outPrim.transmission       = prim.material.transmission;
+            outPrim.vertexBufferOffset = prim.vertexBufferOffset;
+            outPrim.vertexBufferSize   = prim.vertexBufferSize;
+            outPrim.indexBufferOffset  = prim.indexBufferOffset;
+            outPrim.indexBufferSize    = prim.indexBufferSize;
+            std::copy(textureSources.begin(), textureSources.end(), outPrim.textures);
+        }
+    }
+
+    std::vector<CookedTexture> textures;
+    std::string strings;
+    textures.reserve(cook.textures.size());
+    for(const auto& source : cook.textures)
+    {
+        CookedTexture& texture = textures.emplace_back();
+        texture.fileOffset     = static_cast<uint32_t>(strings.size());
+        texture.fileLength     = static_cast<uint32_t>(source.file.size());
+        texture.offset         = source.offset;
+        texture.size           = source.size;
+        texture.minFilter      = source.sampler.minFilter;
+        texture.magFilter      = source.sampler.magFilter;
+        texture.mipFilter      = source.sampler.mipFilter;
+        texture.addressMode    = source.sampler.addressMode;
+        texture.srgb           = source.srgb;
+        strings               += source.file;
+    }
+
+    std::vector<CookedSourceFile> sources;
+    sources.reserve(cook.sourceFiles.size());
+    for(const auto& file : cook.sourceFiles)
+    {
+        CookedSourceFile& source = sources.emplace_back();
+        source.fileOffset        = static_cast<uint32_t>(strings.size());
+        source.fileLength        = static_cast<uint32_t>(file.size());
+        if(!GetSourceStamp(p.parent_path() / std::filesystem::path(std::u8string(file.begin(), file.end())), source.size, source.writeTime))
+            return;
+        strings += file;
+    }
+    header.meshCount       = static_cast<uint32_t>(meshes.size());
+    header.primitiveCount  = static_cast<uint32_t>(primitives.size());
+    header.textureCount    = static_cast<uint32_t>(textures.size());
+    header.sourceFileCount = static_cast<uint32_t>(sources.size());
+    header.stringBytes     = static_cast<uint32_t>(strings.size());
+
+    // reading back host visible memory is slow but this only happens once per model
+    auto vertices = cook.stagingVertexBuffer.Read<uint8_t>();
+    auto indices  = cook.stagingIndexBuffer.Read<uint8_t>();
+
+    std::error_code ec;
+    std::filesystem::create_directories(cookedPath.parent_path(), ec);
+
+    // write next to it and rename so a crash while saving doesn't leave a truncated file behind
+    std::filesystem::path tmpPath = cookedPath;
+    tmpPath += ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        auto write = [&](const void* data, size_t size) { file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)); };
+
+        write(&header, sizeof(header));
+        write(meshes.data(), meshes.size() * sizeof(CookedMesh));
+        write(primitives.data(), primitives.size() * sizeof(CookedPrimitive));
+        write(textures.data(), textures.size() * sizeof(CookedTexture));
+        write(sources.data(), sources.size() * sizeof(CookedSourceFile));
+        write(strings.data(), strings.size());
+
+        const uint64_t written = static_cast<uint64_t>(file.tellp());
+        const char padding[16] = {};
+        write(padding, AlignUp(written, 16) - written);
+        write(vertices.data(), vertices.size());
+        write(indices.data(), indices.size());
+        if(!file)
+        {
+            Log::Warn("Failed to write cooked model {}", tmpPath.string());
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, cookedPath, ec);
+    if(ec)
+        Log::Warn("Failed to move cooked model to {}: {}", cookedPath.string(), ec.message());
+}
+
+namespace
+{
+constexpr uint32_t GLB_MAGIC      = 0x46546C67;  // "glTF"
+constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+constexpr uint32_t GLB_CHUNK_BIN  = 0x004E4942;
+// stands in for the real buffers so tinygltf has nothing to copy
+constexpr const char* PLACEHOLDER_BUFFER_URI = "data:application/octet-stream;base64,AA==";
+
+uint32_t ReadU32(std::span<const uint8_t> bytes, size_t offset)
+{
+    uint32_t v;
+    std::memcpy(&v, bytes.data() + offset, sizeof(uint32_t));
+    return v;
+}
+
+std::span<const uint8_t> MapExternalFile(GltfData& data, const std::filesystem::path& baseDir, const std::string& uri)
+{
+    std::string decoded;
+    tinygltf::URIDecode(uri, &decoded, nullptr);
+    auto path = baseDir / std::filesystem::path(std::u8string(decoded.begin(), decoded.end()));
+
+    const MappedFile& file = *data.files.emplace_back(std::make_shared<MappedFile>(path));
+    data.filePaths.push_back(path);
+    if(!file.IsOpen())
+        throw std::runtime_error(std::format("failed to open {}", path.string()));
+    return file.GetData();
+}
+
+std::span<const uint8_t> GetBufferViewData(const GltfData& data, const tinygltf::BufferView& bv)
+{
+    const auto& buffer = data.buffers[bv.buffer];
+    if(bv.byteOffset + bv.byteLength > buffer.size())
+        throw std::runtime_error("bufferView out of the bounds of its buffer");
+    return buffer.subspan(bv.byteOffset, bv.byteLength);
+}
+}
+
+GltfData LoadGltf(const std::filesystem::path& path)
+{
+    GltfData data;
+    std::span<const uint8_t> bytes;
+    {
+        auto file = std::make_shared<MappedFile>(path);
+        if(!file->IsOpen())
+        {
+            Log::Error("Failed to open glTF {}", path.string());
+            abort();
+        }
+        bytes = file->GetData();
+        data.files.push_back(std::move(file));
+        data.filePaths.push_back(path);
+    }
+
+    std::string_view jsonText;
+    std::span<const uint8_t> binChunk;
+    if(bytes.size() >= 12 && ReadU32(bytes, 0) == GLB_MAGIC)
+    {
+        const uint32_t version = ReadU32(bytes, 4);
+        const size_t length    = std::min<size_t>(ReadU32(bytes, 8), bytes.size());
+        if(version != 2)
+            throw std::runtime_error(std::format("unsupported glb version {}", version));
+
+        size_t offset = 12;
+        while(offset + 8 <= length)
+        {
+            const uint32_t chunkLength = ReadU32(bytes, offset);
+            const uint32_t chunkType   = ReadU32(bytes, offset + 4);
+            offset                    += 8;
+            if(offset + chunkLength > length)
+                throw std::runtime_error("glb chunk goes past the end of the file");
+
+            auto chunk = bytes.subspan(offset, chunkLength);
+            if(chunkType == GLB_CHUNK_JSON && jsonText.empty())
+                jsonText = {reinterpret_cast<const char*>(chunk.data()), chunk.size()};
+            else if(chunkType == GLB_CHUNK_BIN && binChunk.empty())
+                binChunk = chunk;
+            offset += (chunkLength + 3) & ~3u;
+        }
+        if(jsonText.empty())
+            throw std::runtime_error("glb without JSON chunk");
+    }
+    else
+    {
+        jsonText = {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+    }
+
+    nlohmann::json json = nlohmann::json::parse(jsonText.begin(), jsonText.end(), nullptr, false);
+    if(json.is_discarded())
+    {
+        Log::Error("GLTF: invalid JSON in {}", path.string());
+        abort();
+    }
+
+    const auto baseDir = path.parent_path();
+
+    // buffers: the BIN chunk of a glb or external files, both get mapped. Data URIs are left to tinygltf since the JSON holds
+    // them anyway
+    std::vector<bool> decodedByTinygltf;
+    if(json.contains("buffers") && json["buffers"].is_array())
+    {
+        auto& buffers = json["buffers"];
+        data.buffers.resize(buffers.size());
+        decodedByTinygltf.resize(buffers.size(), false);
+        for(size_t i = 0; i < buffers.size(); ++i)
         {
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            auto& buffer            = buffers[i];
+            const std::string uri   = buffer.value("uri", "");
+            const size_t byteLength = buffer.value("byteLength", size_t(0));
+            if(uri.starts_with("data:"))
             {
-                uint16_t tmp;
-                std::memcpy(&tmp, compPtr, sizeof(uint16_t));
-                v = tmp;
-                break;
+                decodedByTinygltf[i] = true;
+                continue;
             }
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+
+            std::span<const uint8_t> source;
+            if(uri.empty())
             {
-                uint8_t tmp;
-                std::memcpy(&tmp, compPtr, sizeof(uint8_t));
-                v = tmp;
-                break;
+                if(binChunk.empty())
+                    throw std::runtime_error(std::format("buffer {} has no uri and there is no glb BIN chunk", i));
+                source = binChunk;
             }
-        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            else
             {
-                uint32_t tmp;
-                std::memcpy(&tmp, compPtr, sizeof(uint32_t));
-                v = tmp;
-                break;
+                source = MapExternalFile(data, baseDir, uri);
             }
-        default:
-            throw std::runtime_error("unsupported index component type");
+            if(byteLength > source.size())
+                throw std::runtime_error(std::format("buffer {} is smaller than its byteLength", i));
+            data.buffers[i] = source.first(byteLength);
+
+            buffer["uri"]        = PLACEHOLDER_BUFFER_URI;
+            buffer["byteLength"] = 1;
         }
-        out.push_back(v);
     }
-    return out;
-}
 
-Image ImageFromGlTFImage(const tinygltf::Image& image, const tinygltf::Sampler& sampler, bool srgb)
-{
-    VkFormat format = VK_FORMAT_UNDEFINED;
-    if(image.component == 4)
+    // images inside a bufferView would make tinygltf decode them from the placeholder buffer, so they are turned into uri images
+    // (which it doesn't load because of TINYGLTF_NO_EXTERNAL_IMAGE) and get resolved below
+    std::vector<int> imageBufferViews;
+    if(json.contains("images") && json["images"].is_array())
     {
-        if(srgb)
-            format = VK_FORMAT_R8G8B8A8_SRGB;
-        else
-            format = VK_FORMAT_R8G8B8A8_UNORM;
+        auto& images = json["images"];
+        imageBufferViews.resize(images.size(), -1);
+        data.encodedImages.resize(images.size());
+        for(size_t i = 0; i < images.size(); ++i)
+        {
+            auto& image = images[i];
+            if(image.contains("bufferView"))
+            {
+                imageBufferViews[i] = image["bufferView"].get<int>();
+                image.erase("bufferView");
+                image["uri"] = std::format("bufferView{}", imageBufferViews[i]);
+                continue;
+            }
+            const std::string uri = image.value("uri", "");
+            if(!uri.empty() && !uri.starts_with("data:"))
+                data.encodedImages[i] = MapExternalFile(data, baseDir, uri);
+        }
     }
-    else if(image.component == 3)
+
+    tinygltf::TinyGLTF loader;
+    std::string err;
+    std::string warn;
+    const std::string patchedJson = json.dump();
+    bool ret                      = loader.LoadASCIIFromString(&data.gltf, &err, &warn, patchedJson.c_str(), static_cast<unsigned int>(patchedJson.size()), baseDir.string());
+
+    if(!warn.empty())
     {
-        if(srgb)
-            format = VK_FORMAT_R8G8B8_SRGB;
-        else
-            format = VK_FORMAT_R8G8B8_UNORM;
+        Log::Warn("GLTF: {}", warn);
+    }
+    if(!err.empty())
+    {
+        Log::Error("GLTF: {}", err);
+    }
+    if(!ret)
+    {
+        Log::Error("Failed to load glTF");
+        abort();
     }
 
-    ImageCreateInfo ci{};
-    ci.format      = format;
-    ci.usage       = VK_IMAGE_USAGE_SAMPLED_BIT;
-    ci.aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
-    ci.layout      = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    ci.debugName   = image.name;
+    for(size_t i = 0; i < decodedByTinygltf.size(); ++i)
+    {
+        if(decodedByTinygltf[i])
+            data.buffers[i] = data.gltf.buffers[i].data;
+    }
+    for(size_t i = 0; i < imageBufferViews.size(); ++i)
+    {
+        if(imageBufferViews[i] >= 0)
+        {
+            data.encodedImages[i] = GetBufferViewData(data, data.gltf.bufferViews[imageBufferViews[i]]);
+            data.gltf.images[i].uri.clear();
+        }
+    }
+
+    return data;
+}
+
+// index into data.files of the file bytes are in, -1 if they aren't from a mapped file
+int FindFile(const GltfData& data, std::span<const uint8_t> bytes)
+{
+    for(size_t i = 0; i < data.files.size(); ++i)
+    {
+        const auto fileData = data.files[i]->GetData();
+        if(bytes.data() >= fileData.data() && bytes.data() + bytes.size() <= fileData.data() + fileData.size())
+            return static_cast<int>(i);
+    }
+    return -1;
+}
 
+std::optional<TextureSource> GetTextureSource(const GltfData& data, const std::filesystem::path& baseDir, int imageIndex, const SamplerConfig& sampler, bool srgb)
+{
+    const auto& encoded = data.encodedImages[imageIndex];
+    if(encoded.empty())
+        return std::nullopt;
+
+    const int file = FindFile(data, encoded);
+    if(file < 0)
+        return std::nullopt;
+    return TextureSource{
+        .file    = data.filePaths[file].lexically_relative(baseDir).generic_string(),
+        .offset  = static_cast<uint64_t>(encoded.data() - data.files[file]->GetData().data()),
+        .size    = encoded.size(),
+        .sampler = sampler,
+        .srgb    = srgb,
+    };
+}
+
+int NumComponents(int type)
+{
+    return tinygltf::GetNumComponentsInType(type);
+}
+int CompSize(int comp)
+{
+    return tinygltf::GetComponentSizeInBytes(comp);
+}
+
+AccessorView GetAccessorView(const GltfData& data, const tinygltf::Accessor& acc, uint32_t componentCount)
+{
+    if(acc.sparse.count > 0)
+        throw std::runtime_error("sparse accessors not supported");
+    if(acc.bufferView < 0)
+        throw std::runtime_error("accessors without bufferView not supported");
+    if(NumComponents(acc.type) != static_cast<int>(componentCount))
+        throw std::runtime_error(std::format("accessor has {} components instead of {}", NumComponents(acc.type), componentCount));
+
+    const tinygltf::BufferView& bv = data.gltf.bufferViews[acc.bufferView];
+    const auto view                = GetBufferViewData(data, bv);
+
+    const size_t elementSize = static_cast<size_t>(CompSize(acc.componentType)) * componentCount;
+    const size_t stride      = bv.byteStride ? bv.byteStride : elementSize;
+    if(acc.count > 0 && acc.byteOffset + (acc.count - 1) * stride + elementSize > view.size())
+        throw std::runtime_error("accessor out of the bounds of its bufferView");
+
+    return AccessorView{
+        .data           = view.data() + acc.byteOffset,
+        .count          = acc.count,
+        .stride         = stride,
+        .componentType  = acc.componentType,
+        .componentCount = componentCount,
+        .normalized     = acc.normalized,
+    };
+}
+
+// KHR_texture_basisu puts a KTX2 image in the extension, source is then only a fallback for loaders without it (or -1)
+int TextureImage(const tinygltf::Texture& texture)
+{
+    auto it = texture.extensions.find("KHR_texture_basisu");
+    if(it != texture.extensions.end() && it->second.Has("source"))
+        return it->second.Get("source").GetNumberAsInt();
+    return texture.source;
+}
+
+SamplerConfig SamplerFromGltf(const tinygltf::Sampler& sampler)
+{
     SamplerConfig samplerConfig{};
     switch(sampler.minFilter)
     {
@@ -591,14 +1412,161 @@ Image ImageFromGlTFImage(const tinygltf::Image& image, const tinygltf::Sampler&
     default:
         assert(!"Invalid gltf sampler wrap mode");
     }
+    return samplerConfig;
+}
 
+std::shared_ptr<Image> GetSharedTexture(const std::filesystem::path& baseDir, const TextureSource& source, const std::function<std::shared_ptr<Image>()>& create)
+{
+    TextureCache* cache = VulkanContext::GetTextureCache();
+    if(!cache)
+        return create();
+
+    // the same file can be reached through different relative paths from different models
+    std::error_code ec;
+    const auto path      = baseDir / std::filesystem::path(std::u8string(source.file.begin(), source.file.end()));
+    const auto canonical = std::filesystem::weakly_canonical(path, ec);
+
+    const TextureKey key{
+        .file    = (ec ? path : canonical).generic_string(),
+        .offset  = source.offset,
+        .size    = source.size,
+        .srgb    = source.srgb,
+        .sampler = source.sampler,
+    };
+    return cache->GetOrCreate(key, create);
+}
+
+std::shared_ptr<Image> ImageFromGlTFImage(const GltfData& data, int imageIndex, const SamplerConfig& sampler, bool srgb)
+{
+    const tinygltf::Image& image = data.gltf.images[imageIndex];
 
-    Image res(image.width, image.height, ci);
-    res.SetSamplerConfig(samplerConfig);
-    Buffer staging(res.GetMemorySize(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
-    staging.Fill(image.image);
-    staging.CopyToImage(res, image.width, image.height);
+    const auto& encoded = data.encodedImages[imageIndex];
+    if(!encoded.empty())
+    {
+        const int file = FindFile(data, encoded);
+        if(file >= 0)
+            return DecodeTexture(encoded, data.files[file], sampler, srgb, image.name);
+
+        // a bufferView of a data URI buffer, that one is owned by tinygltf and goes away with the glTF so the decode gets a copy
+        auto copy = std::make_shared<const std::vector<uint8_t>>(encoded.begin(), encoded.end());
+        return DecodeTexture(*copy, copy, sampler, srgb, image.name);
+    }
+
+    // embedded as a data URI, tinygltf already decoded it
+    if(image.bits != 8 || image.component < 1 || image.component > 4)
+        throw std::runtime_error(std::format("image {} has an unsupported format ({} components, {} bits)", image.name, image.component, image.bits));
+    const auto pixels   = std::make_shared<const std::vector<uint8_t>>(image.image);
+    const int component = image.component;
+    return CreateTexture({
+        .width   = static_cast<uint32_t>(image.width),
+        .height  = static_cast<uint32_t>(image.height),
+        .format  = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM,
+        .sampler = sampler,
+        .name    = image.name,
+        .decode  = [pixels, component](uint8_t* dst)
+        {
+            // 3 component formats are barely supported for sampling, grey is expanded the way stb_image does it
+            const size_t texelCount = pixels->size() / component;
+            std::vector<uint8_t> rgba(texelCount * 4);
+            for(size_t i = 0; i < texelCount; ++i)
+            {
+                const uint8_t* src = pixels->data() + i * component;
+                uint8_t* texel     = rgba.data() + i * 4;
+                texel[0]           = src[0];
+                texel[1]           = component >= 3 ? src[1] : src[0];
+                texel[2]           = component >= 3 ? src[2] : src[0];
+                texel[3]           = component == 2 ? src[1] : component == 4 ? src[3] : 255;
+            }
+            std::memcpy(dst, rgba.data(), rgba.size());
+        },
+    });
+}
+
+std::shared_ptr<Image> DecodeTexture(std::span<const uint8_t> encoded, std::shared_ptr<const void> owner, const SamplerConfig& sampler, bool srgb, const std::string& name)
+{
+    // only the header is read here, the actual decode runs on the texture streamer's workers
+    if(IsKtx2(encoded))
+    {
+        Ktx2Upload upload{};
+        try
+        {
+            upload = PrepareKtx2(encoded, srgb);
+        }
+        catch(const std::exception& e)
+        {
+            throw std::runtime_error(std::format("failed to load KTX2 image {}: {}", name, e.what()));
+        }
+        return CreateTexture({
+            .width      = upload.width,
+            .height     = upload.height,
+            .format     = upload.format,
+            .sampler    = sampler,
+            .name       = name,
+            .mipOffsets = std::move(upload.mipOffsets),
+            .size       = upload.size,
+            .decode     = [write = std::move(upload.write), owner = std::move(owner)](uint8_t* dst) { write(dst); },
+        });
+    }
+
+    int width    = 0;
+    int height   = 0;
+    int channels = 0;
+    if(!stbi_info_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels))
+        throw std::runtime_error(std::format("failed to decode image {}: {}", name, stbi_failure_reason()));
+
+    // owner keeps the memory encoded points into (a file mapping or a copy) alive until the decode is done
+    return CreateTexture({
+        .width   = static_cast<uint32_t>(width),
+        .height  = static_cast<uint32_t>(height),
+        .format  = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM,
+        .sampler = sampler,
+        .name    = name,
+        .decode  = [encoded, owner = std::move(owner), width, height, name](uint8_t* dst)
+        {
+            int decodedWidth  = 0;
+            int decodedHeight = 0;
+            int channels      = 0;
+            std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> decoded(stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &decodedWidth, &decodedHeight, &channels, 4), stbi_image_free);
+            if(!decoded)
+                throw std::runtime_error(std::format("failed to decode image {}: {}", name, stbi_failure_reason()));
+            if(decodedWidth != width || decodedHeight != height)
+                throw std::runtime_error(std::format("image {} decoded to a different size than its header says", name));
+            std::memcpy(dst, decoded.get(), static_cast<size_t>(width) * height * 4);
+        },
+    });
+}
+
+std::shared_ptr<Image> CreateTexture(TextureStreamer::Request request)
+{
+    if(TextureStreamer* streamer = VulkanContext::GetTextureStreamer())
+        return streamer->Load(std::move(request));
+
+    // no renderer to stream with, upload right away
+    ImageCreateInfo ci{};
+    ci.format      = request.format;
+    ci.usage       = VK_IMAGE_USAGE_SAMPLED_BIT;
+    ci.aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+    ci.layout      = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    ci.useMips     = request.mipOffsets.size() != 1;
+    ci.mipLevels   = static_cast<uint32_t>(request.mipOffsets.size());
+    ci.debugName   = request.name;
+
+    auto res = std::make_shared<Image>(request.width, request.height, ci);
+    res->SetSamplerConfig(request.sampler);
+    Buffer staging(request.mipOffsets.empty() ? res->GetMemorySize() : request.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+    request.decode(static_cast<uint8_t*>(staging.GetMappedMemory()));
+
+    if(request.mipOffsets.empty())
+    {
+        staging.CopyToImage(*res, request.width, request.height);
+        res->GenerateMipmaps(VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+        return res;
+    }
 
-    res.TransitionLayout(VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+    CommandBuffer commandBuffer;
+    commandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    staging.CopyToImageMips(commandBuffer, *res, request.mipOffsets);
+    commandBuffer.SubmitIdle();
+    res->TransitionLayout(VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
     return res;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Buffer.hpp"
+#include "VertexFormat.hpp"
 #include <filesystem>
+#include <memory>
 #include <vector>
 #include <span>
 
@@ -30,6 +32,18 @@ struct Camera
         Orthographic orthographic;
     };
 };
+// How a Model gets loaded. Every combination is cooked into a file of its own
+struct ModelOptions
+{
+    // Welds duplicate vertices and reorders the triangles of every primitive for the post transform cache and overdraw, then
+    // its vertices for fetch locality. Only costs time when the model gets cooked, the ACMR before and after is logged.
+    // Off by default since it changes the meshes and the primitives no longer decode straight into the staging buffers
+    bool optimizeMeshes = false;
+    // COMPACT halves the vertex buffer, positions keep 16 bits relative to the bounds of their mesh (Mesh::quantization).
+    // Shaders read the vertices with the module from GenerateVertexAccessor(GetVertexFormat())
+    VertexFormat vertexFormat = VertexFormat::FULL;
+};
+
 class Model
 {
 public:
@@ -49,10 +63,12 @@ public:
 
         glm::vec3 specularTint = glm::vec3(1.0);
 
-        std::optional<Image> baseColorTexture;
-        std::optional<Image> specularTintTexture;
-        std::optional<Image> metallicRoughnessTexture;  // B - metallicness, G - roughness
-        std::optional<Image> emissiveColorTexture;
+        // shared with every other material (of any model) that uses the same image with the same format and sampler,
+        // nullptr if there is none
+        std::shared_ptr<Image> baseColorTexture;
+        std::shared_ptr<Image> specularTintTexture;
+        std::shared_ptr<Image> metallicRoughnessTexture;  // B - metallicness, G - roughness
+        std::shared_ptr<Image> emissiveColorTexture;
     };
     struct Primitive
     {
@@ -66,12 +82,21 @@ public:
     {
         std::vector<Primitive> primitives;
         glm::mat4 transform;
+        // maps the stored positions of every primitive back to object space, identity unless the format is COMPACT
+        PositionQuantization quantization;
     };
 
-    Model(std::filesystem::path p);
+    // The first load of a glTF also writes a cooked copy of it to cacheDirectory (the final vertex and index data, primitives,
+    // meshes, materials and where the textures come from). As long as the glTF file doesn't change, later loads map the cooked
+    // file and copy it straight into staging without parsing anything
+    Model(std::filesystem::path p, const std::filesystem::path& cacheDirectory = "model_cache", const ModelOptions& options = {});
 
+    // size of a VertexFormat::FULL vertex, GetVertexSize is what the buffer actually uses
     static constexpr uint32_t VERTEX_SIZE = (3 + 3 + 2) * sizeof(float);
 
+    VertexFormat GetVertexFormat() const { return m_options.vertexFormat; }
+    uint32_t GetVertexSize() const { return ::GetVertexSize(m_options.vertexFormat); }
+
     const Buffer& GetVertexBuffer() const { return m_vertexBuffer; }
     const Buffer& GetIndexBuffer() const { return m_indexBuffer; }
 
@@ -80,6 +105,13 @@ public:
 
 
 private:
+    struct CookData;
+
+    void LoadFromGltf(const std::filesystem::path& p, CookData& cook);
+    bool LoadCooked(const std::filesystem::path& p, const std::filesystem::path& cookedPath);
+    void WriteCooked(const std::filesystem::path& p, const std::filesystem::path& cookedPath, CookData& cook);
+
+    ModelOptions m_options;
     std::vector<Mesh> m_meshes;
     std::optional<Camera> m_camera;
     Buffer m_vertexBuffer;
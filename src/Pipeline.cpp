@@ -2,19 +2,58 @@
 #include "VulkanContext.hpp"
 #include "Log.hpp"
 #include <cassert>
+#include <algorithm>
 #include "Renderer.hpp"
 #include "Shader.hpp"
+#include "BindlessHeap.hpp"
+#include "ThreadPool.hpp"
 
 Pipeline::Pipeline(const std::string& shaderName, PipelineCreateInfo createInfo)
     : m_name(shaderName),
       m_createInfo(createInfo)
 {
+    // created synchronously, so Setup's own descriptor writes can go through directly
+    m_ready = true;
+    AssignShaders();
     Setup();
 }
 
-void Pipeline::Setup()
+Pipeline::Pipeline(const std::string& shaderName, PipelineCreateInfo createInfo, AsyncTag)
+    : m_name(shaderName),
+      m_createInfo(createInfo)
+{
+    AssignShaders();
+}
+
+std::unique_ptr<Pipeline> Pipeline::CreateAsync(const std::string& shaderName, PipelineCreateInfo createInfo, std::function<void(Pipeline&)> onReady)
+{
+    std::unique_ptr<Pipeline> pipeline(new Pipeline(shaderName, std::move(createInfo), AsyncTag{}));
+
+    Pipeline* p = pipeline.get();
+    auto setup  = [p, onReady = std::move(onReady)]() {
+        p->Setup();
+        {
+            std::scoped_lock lock(p->m_pendingWritesMutex);
+            for(const auto& write : p->m_pendingWrites)
+                p->ApplyDescriptorWrite(write.frameIndex, write.set, write.binding, write.element, write.type, write.info);
+            p->m_pendingWrites.clear();
+            p->m_ready.store(true, std::memory_order_release);
+        }
+        if(onReady)
+            onReady(*p);
+    };
+    p->m_readyFuture = VulkanContext::GetThreadPool()->Submit(std::move(setup)).share();
+    return pipeline;
+}
+
+void Pipeline::WaitUntilReady() const
+{
+    if(m_readyFuture.valid())
+        m_readyFuture.wait();
+}
+
+void Pipeline::AssignShaders()
 {
-    m_vertexInputAttributes.clear();
 
     m_shaders.resize(m_createInfo.shaders.size());
     switch(m_createInfo.type)
@@ -58,8 +97,110 @@ void Pipeline::Setup()
     for(const auto& shader : m_shaders)
     {
         assert(shader && "Pipeline is missing some shaders");
+        if(shader->m_pipeline && shader->m_pipeline != this)
+            Log::Warn("Shader {} is already used by pipeline {}, it only writes to {} from now on. Use Shader::Clone to share it", shader->m_name, shader->m_pipeline->m_name, m_name);
+        shader->CreateUniformBuffers();
+    }
+
+    // done here rather than in Setup so push constants can be set while the pipeline is still being created asynchronously
+    CreatePushConstantRanges();
+    ResolveThreadGroupSize();
+}
+
+void Pipeline::ResolveThreadGroupSize()
+{
+    if(m_createInfo.type != PipelineType::COMPUTE)
+        return;
+
+    // Dispatch computes the group count from the thread group size, so it has to see the specialized value
+    const auto& shader = m_shaders[0];
+    m_threadGroupSize  = {shader->m_numThreadsX, shader->m_numThreadsY, shader->m_numThreadsZ};
+    for(uint32_t axis = 0; axis < 3; axis++)
+    {
+        if(!shader->m_threadGroupSizeIds[axis])
+            continue;
+        for(const auto& [name, value] : m_createInfo.specializationConstants)
+        {
+            auto it = shader->m_specializationConstants.find(name);
+            if(it != shader->m_specializationConstants.end() && it->second == shader->m_threadGroupSizeIds[axis])
+                m_threadGroupSize[axis] = value;
+        }
+    }
+}
+
+void Pipeline::Dispatch(CommandBuffer& cb, uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ) const
+{
+    assert(m_createInfo.type == PipelineType::COMPUTE);
+    uint32_t groupCountX = (threadCountX + m_threadGroupSize[0] - 1) / m_threadGroupSize[0];
+    uint32_t groupCountY = (threadCountY + m_threadGroupSize[1] - 1) / m_threadGroupSize[1];
+    uint32_t groupCountZ = (threadCountZ + m_threadGroupSize[2] - 1) / m_threadGroupSize[2];
+
+    vkCmdDispatch(cb.GetCommandBuffer(), groupCountX, groupCountY, groupCountZ);
+}
+
+void Pipeline::CreatePushConstantRanges()
+{
+    std::vector<VkPushConstantRange> ranges;
+    for(const auto& shader : m_shaders)
+    {
+        if(shader->m_pushConstantRange.size > 0)
+            ranges.push_back(shader->m_pushConstantRange);
+    }
+    std::ranges::sort(ranges, {}, &VkPushConstantRange::offset);
+
+    // a push has to name every stage whose range overlaps the pushed bytes, so overlapping ranges get merged into one
+    m_pushConstantRanges.clear();
+    for(const auto& range : ranges)
+    {
+        if(!m_pushConstantRanges.empty())
+        {
+            auto& last   = m_pushConstantRanges.back();
+            uint32_t end = last.offset + last.size;
+            if(range.offset < end)
+            {
+                last.size        = std::max(end, range.offset + range.size) - last.offset;
+                last.stageFlags |= range.stageFlags;
+                continue;
+            }
+        }
+        m_pushConstantRanges.push_back(range);
+    }
+
+    uint32_t size = 0;
+    for(const auto& range : m_pushConstantRanges)
+        size = std::max(size, range.offset + range.size);
+    if(size > VulkanContext::GetPhysicalDeviceProperties().limits.maxPushConstantsSize)
+        Log::Error("Pipeline {} uses {} bytes of push constants but the device only supports {}", m_name, size, VulkanContext::GetPhysicalDeviceProperties().limits.maxPushConstantsSize);
+
+    m_pushConstantData.assign(size, 0);
+    AttachShaders();
+}
+
+void Pipeline::AttachShaders()
+{
+    for(const auto& shader : m_shaders)
+    {
+        shader->m_pipeline         = this;
+        shader->m_pushConstantData = m_pushConstantData;
     }
+}
 
+void Pipeline::DetachShaders()
+{
+    // the shaders can outlive the pipeline, they must not keep pointing into it. One that moved on to another pipeline is left alone
+    for(const auto& shader : m_shaders)
+    {
+        if(shader && shader->m_pipeline == this)
+        {
+            shader->m_pipeline         = nullptr;
+            shader->m_pushConstantData = {};
+        }
+    }
+}
+
+void Pipeline::Setup()
+{
+    m_vertexInputAttributes.clear();
 
     CreateDescriptors();
 
@@ -68,6 +209,8 @@ void Pipeline::Setup()
         shader->Finalize(this);
     }
 
+    CreateSpecializations();
+
     switch(m_createInfo.type)
     {
     case PipelineType::GRAPHICS:
@@ -85,20 +228,68 @@ void Pipeline::Setup()
     {
         shader->DestroyShaderModule();
     }
+    m_specializations.clear();
 
     VK_SET_DEBUG_NAME(m_pipeline, VK_OBJECT_TYPE_PIPELINE, m_shaders[0]->m_name.c_str());
 }
 
+void Pipeline::CreateSpecializations()
+{
+    m_specializations.assign(m_shaders.size(), {});
+    for(const auto& [name, value] : m_createInfo.specializationConstants)
+    {
+        bool found = false;
+        for(uint32_t i = 0; i < m_shaders.size(); i++)
+        {
+            auto it = m_shaders[i]->m_specializationConstants.find(name);
+            if(it == m_shaders[i]->m_specializationConstants.end())
+                continue;
+
+            auto& specialization = m_specializations[i];
+            specialization.entries.push_back({it->second, static_cast<uint32_t>(specialization.data.size() * sizeof(uint32_t)), sizeof(uint32_t)});
+            specialization.data.push_back(value);
+            found = true;
+        }
+        if(!found)
+            Log::Warn("Pipeline {}: none of the shaders has a specialization constant named {}", m_name, name);
+    }
+
+    for(uint32_t i = 0; i < m_shaders.size(); i++)
+    {
+        auto& specialization              = m_specializations[i];
+        specialization.info.mapEntryCount = static_cast<uint32_t>(specialization.entries.size());
+        specialization.info.pMapEntries   = specialization.entries.data();
+        specialization.info.dataSize      = specialization.data.size() * sizeof(uint32_t);
+        specialization.info.pData         = specialization.data.data();
+    }
+}
+
+const VkSpecializationInfo* Pipeline::GetSpecializationInfo(uint32_t shaderIndex) const
+{
+    if(shaderIndex >= m_specializations.size() || m_specializations[shaderIndex].entries.empty())
+        return nullptr;
+    return &m_specializations[shaderIndex].info;
+}
+
 Pipeline::~Pipeline()
 {
+    // the worker is still using this pipeline
+    WaitUntilReady();
+    DetachShaders();
+
     if(m_pipeline != VK_NULL_HANDLE)
     {
-        for(auto layout : m_descriptorLayouts)
+        // the layouts belong to the layout cache, only the sets go back to the allocator
+        DescriptorAllocator* allocator = VulkanContext::GetDescriptorAllocator();
+        for(const auto& sets : m_descriptorSets)
         {
-            vkDestroyDescriptorSetLayout(VulkanContext::GetDevice(), layout, nullptr);
+            for(uint32_t i = 0; i < sets.size() && allocator; i++)
+            {
+                if(sets[i] != VK_NULL_HANDLE && !(m_usesBindlessHeap && i == BindlessHeap::SET))
+                    allocator->Free(m_descriptorLayouts[i], sets[i]);
+            }
         }
         vkDestroyPipeline(VulkanContext::GetDevice(), m_pipeline, nullptr);
-        vkDestroyPipelineLayout(VulkanContext::GetDevice(), m_layout, nullptr);
 
         m_pipeline = VK_NULL_HANDLE;
     }
@@ -114,37 +305,137 @@ void Pipeline::CreateDescriptors()
             descriptorLayoutBuilders[i] += shader->m_descriptorLayoutBuilders[i];
         }
     }
-    for(auto builder : descriptorLayoutBuilders)
+    // sets need to keep their index in the pipeline layout, so unused sets before the last used one get an empty layout
+    uint32_t setCount = 0;
+    for(uint32_t i = 0; i < descriptorLayoutBuilders.size(); i++)
     {
-        // NOTE: can we have non continuous descriptors? like 0 and 2 are filled but not 1
-        if(!builder.bindings.empty())
-            m_descriptorLayouts.push_back(builder.Build());
+        if(!descriptorLayoutBuilders[i].bindings.empty())
+            setCount = i + 1;
     }
 
-    if(m_descriptorLayouts.size() == 0)
-        return;
+    DescriptorLayoutCache* layoutCache = VulkanContext::GetDescriptorLayoutCache();
 
-    m_descriptorSets.resize(Renderer::MAX_FRAMES_IN_FLIGHT);
+    // shaders that declare bindings in the bindless set get the global heap bound there
+    m_usesBindlessHeap = setCount > BindlessHeap::SET && !descriptorLayoutBuilders[BindlessHeap::SET].bindings.empty();
+    if(m_usesBindlessHeap)
+    {
+        for(const auto& binding : descriptorLayoutBuilders[BindlessHeap::SET].bindings)
+        {
+            if(binding.binding >= BindlessHeap::BINDING_COUNT || binding.descriptorType != BindlessHeap::GetDescriptorType(static_cast<BindlessHeap::Binding>(binding.binding)))
+                Log::Error("Pipeline {}: binding {} ({}) of set {} doesn't match the bindless heap layout", m_name, binding.binding, string_VkDescriptorType(binding.descriptorType), BindlessHeap::SET);
+        }
+    }
 
+    if(m_createInfo.useDescriptorBuffer)
+    {
+        if(!VulkanContext::GetDescriptorBuffer())
+        {
+            Log::Warn("Pipeline {} requested a descriptor buffer but they aren't supported, falling back to descriptor sets", m_name);
+            m_createInfo.useDescriptorBuffer = false;
+        }
+        else if(m_usesBindlessHeap || m_createInfo.pushDescriptorSet)
+        {
+            // every set of a descriptor buffer pipeline has to come from a descriptor buffer
+            Log::Warn("Pipeline {} can't use a descriptor buffer together with push descriptors or the bindless heap, falling back to descriptor sets", m_name);
+            m_createInfo.useDescriptorBuffer = false;
+        }
+    }
 
-    for(uint32_t i = 0; i < m_descriptorLayouts.size(); i++)
+    if(m_createInfo.useDescriptorBuffer)
     {
-        auto name = std::format("dsl_{}_{}", m_name, i);
-        VK_SET_DEBUG_NAME(m_descriptorLayouts[i], VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, name.c_str());
+        for(uint32_t i = 0; i < setCount; i++)
+            m_descriptorLayouts.push_back(layoutCache->GetSetLayout(descriptorLayoutBuilders[i], VK_SHADER_STAGE_ALL, VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT));
+        m_descriptorBufferSets.resize(Renderer::MAX_FRAMES_IN_FLIGHT);
+        for(auto& sets : m_descriptorBufferSets)
+        {
+            for(uint32_t i = 0; i < setCount; i++)
+                sets.emplace_back(descriptorLayoutBuilders[i], m_descriptorLayouts[i]);
+        }
+        return;
     }
-    for(int frameIndex = 0; frameIndex < Renderer::MAX_FRAMES_IN_FLIGHT; frameIndex++)
+
+    if(m_createInfo.pushDescriptorSet)
+    {
+        uint32_t pushSet = m_createInfo.pushDescriptorSet.value();
+        if(!VulkanContext::SupportsPushDescriptors())
+        {
+            Log::Warn("Pipeline {} requested set {} as push descriptor set but the device doesn't support them, falling back to a regular set", m_name, pushSet);
+            m_createInfo.pushDescriptorSet.reset();
+        }
+        else if(pushSet >= setCount || descriptorLayoutBuilders[pushSet].bindings.empty())
+        {
+            Log::Warn("Pipeline {} requested set {} as push descriptor set but no shader uses it", m_name, pushSet);
+            m_createInfo.pushDescriptorSet.reset();
+        }
+        else if(m_usesBindlessHeap && pushSet == BindlessHeap::SET)
+        {
+            Log::Error("Pipeline {} requested the bindless set {} as push descriptor set, ignoring it", m_name, pushSet);
+            m_createInfo.pushDescriptorSet.reset();
+        }
+        else
+        {
+            VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties{};
+            pushDescriptorProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+            VkPhysicalDeviceProperties2 deviceProperties2{};
+            deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            deviceProperties2.pNext = &pushDescriptorProperties;
+            vkGetPhysicalDeviceProperties2(VulkanContext::GetPhysicalDevice(), &deviceProperties2);
+
+            const auto& builder      = descriptorLayoutBuilders[pushSet];
+            uint32_t descriptorCount = 0;
+            for(const auto& binding : builder.bindings)
+            {
+                descriptorCount += binding.descriptorCount;
+            }
+
+            if(std::ranges::contains(builder.isVariableSize, true) || descriptorCount > pushDescriptorProperties.maxPushDescriptors)
+            {
+                Log::Error("Set {} of pipeline {} can't be a push descriptor set (variable sized arrays or more than {} descriptors), falling back to a regular set", pushSet, m_name, pushDescriptorProperties.maxPushDescriptors);
+                m_createInfo.pushDescriptorSet.reset();
+            }
+        }
+    }
+
+    for(uint32_t i = 0; i < setCount; i++)
     {
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool     = VulkanContext::GetDescriptorPool();
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(m_descriptorLayouts.size());
-        allocInfo.pSetLayouts        = m_descriptorLayouts.data();
+        if(m_usesBindlessHeap && i == BindlessHeap::SET)
+        {
+            m_descriptorLayouts.push_back(VulkanContext::GetBindlessHeap()->GetLayout());
+            m_descriptorTemplates.emplace_back(DescriptorSetLayoutBuilder{}, VK_NULL_HANDLE);
+            continue;
+        }
+        bool isPushDescriptor = m_createInfo.pushDescriptorSet == i;
+        m_descriptorLayouts.push_back(layoutCache->GetSetLayout(descriptorLayoutBuilders[i], VK_SHADER_STAGE_ALL, isPushDescriptor ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0));
+        m_descriptorTemplates.emplace_back(descriptorLayoutBuilders[i], isPushDescriptor ? VK_NULL_HANDLE : m_descriptorLayouts.back());
+    }
+
+    if(m_descriptorLayouts.size() == 0)
+        return;
 
-        m_descriptorSets[frameIndex].resize(m_descriptorLayouts.size());
+    // push descriptor sets aren't allocated and the bindless set already exists
+    auto isAllocated = [this](uint32_t set) { return m_createInfo.pushDescriptorSet != set && !(m_usesBindlessHeap && set == BindlessHeap::SET); };
 
-        VK_CHECK(vkAllocateDescriptorSets(VulkanContext::GetDevice(), &allocInfo, m_descriptorSets[frameIndex].data()), "Failed to allocate descriptors");
+    m_descriptorSets.resize(Renderer::MAX_FRAMES_IN_FLIGHT);
+    m_descriptorShadows.resize(Renderer::MAX_FRAMES_IN_FLIGHT);
+
+    for(int frameIndex = 0; frameIndex < Renderer::MAX_FRAMES_IN_FLIGHT; frameIndex++)
+    {
+        m_descriptorSets[frameIndex].resize(m_descriptorLayouts.size(), VK_NULL_HANDLE);
         for(uint32_t i = 0; i < m_descriptorLayouts.size(); i++)
         {
+            if(isAllocated(i))
+                m_descriptorSets[frameIndex][i] = VulkanContext::GetDescriptorAllocator()->Allocate(m_descriptorLayouts[i], descriptorLayoutBuilders[i]);
+            else if(m_createInfo.pushDescriptorSet != i)
+                m_descriptorSets[frameIndex][i] = VulkanContext::GetBindlessHeap()->GetSet();
+        }
+        for(const auto& descriptorTemplate : m_descriptorTemplates)
+        {
+            m_descriptorShadows[frameIndex].push_back(descriptorTemplate.CreateShadow());
+        }
+        for(uint32_t i = 0; i < m_descriptorLayouts.size(); i++)
+        {
+            if(!isAllocated(i) || m_descriptorSets[frameIndex][i] == VK_NULL_HANDLE)
+                continue;
             auto name = std::format("ds_{}_{}_{}", m_name, frameIndex, i);
             VK_SET_DEBUG_NAME(m_descriptorSets[frameIndex][i], VK_OBJECT_TYPE_DESCRIPTOR_SET, name.c_str());
         }
@@ -161,6 +452,7 @@ void Pipeline::CreateGraphicsPipeline()
         ci.stage                           = shader->m_stage;
         ci.pName                           = "main";
         ci.module                          = shader->GetShaderModule();
+        ci.pSpecializationInfo             = GetSpecializationInfo(static_cast<uint32_t>(stagesCI.size()));
 
         stagesCI.push_back(ci);
     }
@@ -270,16 +562,7 @@ void Pipeline::CreateGraphicsPipeline()
 
 
     // ##################### LAYOUT #####################
-    VkDescriptorSetLayout descSetLayout         = VK_NULL_HANDLE;
-    VkPushConstantRange pcRange                 = VulkanContext::GetGlobalPushConstantRange();
-    VkPipelineLayoutCreateInfo layoutCreateInfo = {};
-    layoutCreateInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layoutCreateInfo.setLayoutCount             = 1;
-    layoutCreateInfo.pSetLayouts                = &descSetLayout;
-    layoutCreateInfo.pushConstantRangeCount     = 1;
-    layoutCreateInfo.pPushConstantRanges        = &pcRange;
-
-    VK_CHECK(vkCreatePipelineLayout(VulkanContext::GetDevice(), &layoutCreateInfo, nullptr, &m_layout), "Failed to create pipeline layout");
+    m_layout = VulkanContext::GetDescriptorLayoutCache()->GetPipelineLayout({VK_NULL_HANDLE}, {VulkanContext::GetGlobalPushConstantRange()});
 
 
     // ##################### RENDERING #####################
@@ -324,13 +607,16 @@ void Pipeline::CreateGraphicsPipeline()
     if(m_createInfo.useDynamicViewport)
         pipelineInfo.pDynamicState = &dynamicState;
 
+    if(m_createInfo.useDescriptorBuffer)
+        pipelineInfo.flags |= VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+
     pipelineInfo.layout     = m_layout;
     pipelineInfo.renderPass = VK_NULL_HANDLE;
     pipelineInfo.subpass    = 0;
 
     pipelineInfo.pNext = &renderingCreateInfo;
 
-    VK_CHECK(vkCreateGraphicsPipelines(VulkanContext::GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline), "Failed to create graphics pipeline");
+    VK_CHECK(vkCreateGraphicsPipelines(VulkanContext::GetDevice(), VulkanContext::GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_pipeline), "Failed to create graphics pipeline");
 }
 
 void Pipeline::CreateComputePipeline()
@@ -340,16 +626,9 @@ void Pipeline::CreateComputePipeline()
     shaderCi.stage                           = VK_SHADER_STAGE_COMPUTE_BIT;
     shaderCi.pName                           = "main";
     shaderCi.module                          = m_shaders[0]->GetShaderModule();  // only 1 compute shader allowed
+    shaderCi.pSpecializationInfo             = GetSpecializationInfo(0);
 
-    VkPipelineLayoutCreateInfo layoutCreateInfo = {};
-    layoutCreateInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layoutCreateInfo.setLayoutCount             = m_descriptorLayouts.size();
-    layoutCreateInfo.pSetLayouts                = m_descriptorLayouts.data();
-    layoutCreateInfo.pushConstantRangeCount     = m_shaders[0]->m_pushConstantRange.size > 0 ? 1 : 0;
-    layoutCreateInfo.pPushConstantRanges        = &m_shaders[0]->m_pushConstantRange;
-
-
-    VK_CHECK(vkCreatePipelineLayout(VulkanContext::GetDevice(), &layoutCreateInfo, nullptr, &m_layout), "Failed to create compute pipeline layout");
+    m_layout = VulkanContext::GetDescriptorLayoutCache()->GetPipelineLayout(m_descriptorLayouts, m_pushConstantRanges);
 
 
     VkComputePipelineCreateInfo pipelineCI = {};
@@ -364,27 +643,15 @@ void Pipeline::CreateComputePipeline()
         pipelineCI.basePipelineHandle = m_createInfo.parent->m_pipeline;
         pipelineCI.basePipelineIndex  = -1;
     }
+    if(m_createInfo.useDescriptorBuffer)
+        pipelineCI.flags |= VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
 
-    VK_CHECK(vkCreateComputePipelines(VulkanContext::GetDevice(), VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &m_pipeline), "Failed to create compute pipeline");
+    VK_CHECK(vkCreateComputePipelines(VulkanContext::GetDevice(), VulkanContext::GetPipelineCache(), 1, &pipelineCI, nullptr, &m_pipeline), "Failed to create compute pipeline");
 }
 
 void Pipeline::CreateRaytracingPipeline()
 {
-    std::vector<VkPushConstantRange> pushConstantRanges;
-    for(const auto& shader : m_shaders)
-    {
-        if(shader->m_pushConstantRange.size > 0)
-        {
-            pushConstantRanges.push_back(shader->m_pushConstantRange);
-        }
-    }
-    VkPipelineLayoutCreateInfo pipelineLayoutCI{};
-    pipelineLayoutCI.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutCI.setLayoutCount         = m_descriptorLayouts.size();
-    pipelineLayoutCI.pSetLayouts            = m_descriptorLayouts.data();
-    pipelineLayoutCI.pushConstantRangeCount = pushConstantRanges.size();
-    pipelineLayoutCI.pPushConstantRanges    = pushConstantRanges.data();
-    VK_CHECK(vkCreatePipelineLayout(VulkanContext::GetDevice(), &pipelineLayoutCI, nullptr, &m_layout), "Failed to create pipeline layout");
+    m_layout = VulkanContext::GetDescriptorLayoutCache()->GetPipelineLayout(m_descriptorLayouts, m_pushConstantRanges);
 
     std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
 
@@ -392,10 +659,11 @@ void Pipeline::CreateRaytracingPipeline()
     // Ray generation group
     {
         VkPipelineShaderStageCreateInfo shaderCi{};
-        shaderCi.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderCi.stage  = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
-        shaderCi.pName  = "main";
-        shaderCi.module = m_shaders[0]->GetShaderModule();
+        shaderCi.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderCi.stage               = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+        shaderCi.pName               = "main";
+        shaderCi.module              = m_shaders[0]->GetShaderModule();
+        shaderCi.pSpecializationInfo = GetSpecializationInfo(0);
         shaderStages.push_back(shaderCi);
 
         VkRayTracingShaderGroupCreateInfoKHR shaderGroup{};
@@ -411,10 +679,11 @@ void Pipeline::CreateRaytracingPipeline()
     // Miss group
     {
         VkPipelineShaderStageCreateInfo shaderCi{};
-        shaderCi.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderCi.stage  = VK_SHADER_STAGE_MISS_BIT_KHR;
-        shaderCi.pName  = "main";
-        shaderCi.module = m_shaders[1]->GetShaderModule();
+        shaderCi.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderCi.stage               = VK_SHADER_STAGE_MISS_BIT_KHR;
+        shaderCi.pName               = "main";
+        shaderCi.module              = m_shaders[1]->GetShaderModule();
+        shaderCi.pSpecializationInfo = GetSpecializationInfo(1);
         shaderStages.push_back(shaderCi);
 
         VkRayTracingShaderGroupCreateInfoKHR shaderGroup{};
@@ -430,10 +699,11 @@ void Pipeline::CreateRaytracingPipeline()
     // Closest hit group
     {
         VkPipelineShaderStageCreateInfo shaderCi{};
-        shaderCi.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shaderCi.stage  = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-        shaderCi.pName  = "main";
-        shaderCi.module = m_shaders[2]->GetShaderModule();
+        shaderCi.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderCi.stage               = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+        shaderCi.pName               = "main";
+        shaderCi.module              = m_shaders[2]->GetShaderModule();
+        shaderCi.pSpecializationInfo = GetSpecializationInfo(2);
         shaderStages.push_back(shaderCi);
 
         VkRayTracingShaderGroupCreateInfoKHR shaderGroup{};
@@ -454,7 +724,9 @@ void Pipeline::CreateRaytracingPipeline()
     rayTracingPipelineCI.pGroups                      = shaderGroups.data();
     rayTracingPipelineCI.maxPipelineRayRecursionDepth = 1;
     rayTracingPipelineCI.layout                       = m_layout;
-    VK_CHECK(vkCreateRayTracingPipelinesKHR(VulkanContext::GetDevice(), VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rayTracingPipelineCI, nullptr, &m_pipeline), "Failed to create ray tracing pipeline");
+    if(m_createInfo.useDescriptorBuffer)
+        rayTracingPipelineCI.flags = VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+    VK_CHECK(vkCreateRayTracingPipelinesKHR(VulkanContext::GetDevice(), VK_NULL_HANDLE, VulkanContext::GetPipelineCache(), 1, &rayTracingPipelineCI, nullptr, &m_pipeline), "Failed to create ray tracing pipeline");
 
 
     // TODO: allow more flexible shader setup rather than 1 raygen + 1 miss + 1 closest hit
@@ -516,8 +788,11 @@ void Pipeline::CreateRaytracingPipeline()
     }
 }
 
-void Pipeline::Bind(CommandBuffer& cb, uint32_t frameIndex) const
+bool Pipeline::Bind(CommandBuffer& cb, uint32_t frameIndex) const
 {
+    if(!IsReady())
+        return m_createInfo.fallback && m_createInfo.fallback->Bind(cb, frameIndex);
+
     VkPipelineBindPoint bindPoint;
     switch(m_createInfo.type)
     {
@@ -531,14 +806,110 @@ void Pipeline::Bind(CommandBuffer& cb, uint32_t frameIndex) const
         bindPoint = VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
         break;
     }
-    if(!m_descriptorSets.empty())
+    FlushDescriptors();
+    if(m_createInfo.useDescriptorBuffer && !m_descriptorBufferSets.empty())
     {
-        vkCmdBindDescriptorSets(cb.GetCommandBuffer(), bindPoint, m_layout, 0, m_descriptorSets[frameIndex].size(), m_descriptorSets[frameIndex].data(), 0, nullptr);
+        // every bind gets its own copy of the sets, so writes after this don't affect already recorded work
+        DescriptorBuffer* descriptorBuffer = VulkanContext::GetDescriptorBuffer();
+        const auto& sets                   = m_descriptorBufferSets[frameIndex];
+
+        std::vector<uint32_t> bufferIndices(sets.size(), 0);
+        std::vector<VkDeviceSize> offsets;
+        for(const auto& set : sets)
+            offsets.push_back(descriptorBuffer->Upload(set));
+
+        descriptorBuffer->Bind(cb.GetCommandBuffer());
+        vkCmdSetDescriptorBufferOffsetsEXT(cb.GetCommandBuffer(), bindPoint, m_layout, 0, static_cast<uint32_t>(sets.size()), bufferIndices.data(), offsets.data());
+        cb.GetBoundDescriptorSets(bindPoint) = {};
     }
-    for(auto& shader : m_shaders)
+    else if(!m_descriptorSets.empty())
+    {
+        // sets that are still bound with the same pipeline layout (e.g. the bindless set) don't need to be bound again
+        auto& bound      = cb.GetBoundDescriptorSets(bindPoint);
+        auto isBound     = [&](uint32_t set) { return bound.layout == m_layout && set < bound.sets.size() && bound.sets[set] == m_descriptorSets[frameIndex][set]; };
+        // bind the sets in runs around the push descriptor set since that one doesn't exist
+        const auto& sets = m_descriptorSets[frameIndex];
+        uint32_t first   = 0;
+        for(uint32_t i = 0; i <= sets.size(); i++)
+        {
+            if(i == sets.size() || sets[i] == VK_NULL_HANDLE || isBound(i))
+            {
+                if(i > first)
+                    vkCmdBindDescriptorSets(cb.GetCommandBuffer(), bindPoint, m_layout, first, i - first, &sets[first], 0, nullptr);
+                first = i + 1;
+            }
+        }
+        bound.layout = m_layout;
+        bound.sets   = sets;
+    }
+    else
     {
-        // FIXME: push constants don't work if multiple stages use the same range. In this case we'd need to specify every stage flag in the vkCmdPushConstants call which we aren't doing yet
-        shader->BindResources(cb, frameIndex, m_layout, bindPoint);
+        cb.GetBoundDescriptorSets(bindPoint) = {};
+    }
+    if(m_createInfo.pushDescriptorSet)
+    {
+        uint32_t set = m_createInfo.pushDescriptorSet.value();
+        m_descriptorTemplates[set].Enqueue(m_descriptorShadows[frameIndex][set], VK_NULL_HANDLE, m_pushDescriptorWriter);
+        m_pushDescriptorWriter.Push(cb.GetCommandBuffer(), bindPoint, m_layout, set);
+    }
+    for(const auto& range : m_pushConstantRanges)
+    {
+        vkCmdPushConstants(cb.GetCommandBuffer(), m_layout, range.stageFlags, range.offset, range.size, &m_pushConstantData[range.offset]);
     }
     vkCmdBindPipeline(cb.GetCommandBuffer(), bindPoint, m_pipeline);
+    return true;
+}
+
+void Pipeline::WriteDescriptor(uint32_t frameIndex, uint32_t set, uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info)
+{
+    if(!IsReady())
+    {
+        std::scoped_lock lock(m_pendingWritesMutex);
+        // checked again under the lock since the worker could have finished in the meantime
+        if(!m_ready.load(std::memory_order_relaxed))
+        {
+            m_pendingWrites.push_back({frameIndex, set, binding, element, type, info});
+            return;
+        }
+    }
+    ApplyDescriptorWrite(frameIndex, set, binding, element, type, info);
+}
+
+void Pipeline::ApplyDescriptorWrite(uint32_t frameIndex, uint32_t set, uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info)
+{
+    if(m_createInfo.useDescriptorBuffer)
+    {
+        m_descriptorBufferSets[frameIndex][set].Write(binding, element, type, info);
+        return;
+    }
+
+    if(m_descriptorTemplates[set].Write(m_descriptorShadows[frameIndex][set], binding, element, info))
+        return;
+
+    if(m_createInfo.pushDescriptorSet == set)
+    {
+        Log::Error("Binding {} of set {} can't be written since set {} is a push descriptor set", binding, set, set);
+        return;
+    }
+    if(m_usesBindlessHeap && set == BindlessHeap::SET)
+    {
+        Log::Error("Binding {} of set {} can't be written through the pipeline, it's the bindless heap. Use the resource's bindless index instead", binding, set);
+        return;
+    }
+
+    m_descriptorWriter.Write(m_descriptorSets[frameIndex][set], binding, element, type, info);
+}
+
+void Pipeline::FlushDescriptors() const
+{
+    for(uint32_t frameIndex = 0; frameIndex < m_descriptorShadows.size(); frameIndex++)
+    {
+        for(uint32_t set = 0; set < m_descriptorTemplates.size(); set++)
+        {
+            if(m_createInfo.pushDescriptorSet == set)
+                continue;
+            m_descriptorTemplates[set].Flush(m_descriptorShadows[frameIndex][set], m_descriptorSets[frameIndex][set], m_descriptorWriter);
+        }
+    }
+    m_descriptorWriter.Flush();
 }
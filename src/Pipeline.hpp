@@ -5,7 +5,16 @@
 #include <memory>
 #include <volk.h>
 #include <optional>
+#include <map>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <array>
 #include "Buffer.hpp"
+#include "DescriptorSet.hpp"
+#include "DescriptorBuffer.hpp"
 
 class Shader;
 
@@ -53,6 +62,22 @@ struct PipelineCreateInfo
     uint32_t viewMask = 0;
 
     bool isGlobal = false;
+
+    // build this set as a push descriptor layout: its bindings get recorded into the command buffer
+    // at every Bind instead of living in a pool allocated set, so they can change between dispatches.
+    // Ignored (a regular set) if the device doesn't support VK_KHR_push_descriptor
+    std::optional<uint32_t> pushDescriptorSet;
+
+    // write descriptors straight into GPU memory (VK_EXT_descriptor_buffer) instead of pool allocated sets.
+    // Falls back to descriptor sets if the extension isn't supported or the pipeline uses push descriptors or the bindless heap
+    bool useDescriptorBuffer = false;
+
+    // bound instead of this pipeline while it's still being created by Pipeline::CreateAsync, nothing gets bound if it's null
+    Pipeline* fallback = nullptr;
+
+    // values of the shaders' specialization constants by name, e.g. [SpecializationConstant] const uint GROUP_SIZE = 64;
+    // Only 32 bit constants (bool, int, uint, float bits). A constant used in [numthreads] also changes the size Shader::Dispatch uses
+    std::map<std::string, uint32_t> specializationConstants;
 };
 
 struct SBT
@@ -69,6 +94,11 @@ public:
     Pipeline(const std::string& shaderName, PipelineCreateInfo createInfo);
     ~Pipeline();
 
+    // Creates the pipeline on the thread pool so driver compilation never stalls the frame. Descriptor writes done before it's
+    // ready get queued and applied once it is. onReady gets called on the worker thread.
+    // The shaders must not be used by another pipeline that is being created at the same time
+    static std::unique_ptr<Pipeline> CreateAsync(const std::string& shaderName, PipelineCreateInfo createInfo, std::function<void(Pipeline&)> onReady = {});
+
 
     Pipeline(const Pipeline& other) = delete;
 
@@ -78,10 +108,21 @@ public:
           m_pipeline(other.m_pipeline),
           m_layout(other.m_layout),
           m_usesDescriptorSet(other.m_usesDescriptorSet),
+          m_usesBindlessHeap(other.m_usesBindlessHeap),
           m_vertexInputAttributes(std::move(other.m_vertexInputAttributes)),
-          m_vertexInputBinding(other.m_vertexInputBinding)
+          m_vertexInputBinding(other.m_vertexInputBinding),
+          m_pushConstantRanges(std::move(other.m_pushConstantRanges)),
+          m_pushConstantData(std::move(other.m_pushConstantData)),
+          m_descriptorWriter(std::move(other.m_descriptorWriter)),
+          m_descriptorTemplates(std::move(other.m_descriptorTemplates)),
+          m_descriptorShadows(std::move(other.m_descriptorShadows)),
+          m_descriptorBufferSets(std::move(other.m_descriptorBufferSets)),
+          m_threadGroupSize(other.m_threadGroupSize),
+          m_ready(other.m_ready.load())
     {
+        assert(other.IsReady() && "Pipelines can't be moved while they are still being created");
         other.m_pipeline = VK_NULL_HANDLE;
+        AttachShaders();
     }
 
     Pipeline& operator=(const Pipeline& other) = delete;
@@ -90,22 +131,40 @@ public:
     {
         if(this == &other)
             return *this;
+        assert(IsReady() && other.IsReady() && "Pipelines can't be moved while they are still being created");
+        DetachShaders();
         m_name                  = std::move(other.m_name);
         m_shaders               = std::move(other.m_shaders);
         m_pipeline              = other.m_pipeline;
         m_layout                = other.m_layout;
         m_usesDescriptorSet     = other.m_usesDescriptorSet;
+        m_usesBindlessHeap      = other.m_usesBindlessHeap;
         m_vertexInputAttributes = std::move(other.m_vertexInputAttributes);
         m_vertexInputBinding    = other.m_vertexInputBinding;
+        m_pushConstantRanges    = std::move(other.m_pushConstantRanges);
+        m_pushConstantData      = std::move(other.m_pushConstantData);
+        m_descriptorWriter      = std::move(other.m_descriptorWriter);
+        m_descriptorTemplates   = std::move(other.m_descriptorTemplates);
+        m_descriptorShadows     = std::move(other.m_descriptorShadows);
+        m_descriptorBufferSets  = std::move(other.m_descriptorBufferSets);
+        m_threadGroupSize       = other.m_threadGroupSize;
 
         other.m_pipeline = VK_NULL_HANDLE;
+        AttachShaders();
         return *this;
     }
 
-    void Bind(CommandBuffer& cb, uint32_t frameIndex) const;
+    // returns false if nothing got bound because the pipeline isn't ready yet and there is no fallback
+    bool Bind(CommandBuffer& cb, uint32_t frameIndex) const;
+    [[nodiscard]] bool IsReady() const { return m_ready.load(std::memory_order_acquire); }
+    void WaitUntilReady() const;
     [[nodiscard]] uint32_t GetViewMask() const { return m_createInfo.viewMask; }
     std::shared_ptr<Shader> GetShader(uint32_t idx) { return m_shaders[idx]; }
 
+    // thread group size of the compute shader with this pipeline's specialization constants applied
+    [[nodiscard]] std::array<uint32_t, 3> GetThreadGroupSize() const { return m_threadGroupSize; }
+    void Dispatch(CommandBuffer& cb, uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ) const;
+
     SBT GetSBT() const { return m_sbt; }
 
 
@@ -115,13 +174,30 @@ private:
     friend class DescriptorSetAllocator;
     friend class Shader;
 
+    struct AsyncTag
+    {
+    };
+    Pipeline(const std::string& shaderName, PipelineCreateInfo createInfo, AsyncTag);
+
+    void AssignShaders();
+    void ResolveThreadGroupSize();
+    void CreatePushConstantRanges();
+    // the shaders point back at their pipeline and into its push constant data, so that has to follow moves and destruction
+    void AttachShaders();
+    void DetachShaders();
     void Setup();
 
     void CreateDescriptors();
+    void CreateSpecializations();
+    [[nodiscard]] const VkSpecializationInfo* GetSpecializationInfo(uint32_t shaderIndex) const;
     void CreateGraphicsPipeline();
     void CreateComputePipeline();
     void CreateRaytracingPipeline();
 
+    void WriteDescriptor(uint32_t frameIndex, uint32_t set, uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info);
+    void ApplyDescriptorWrite(uint32_t frameIndex, uint32_t set, uint32_t binding, uint32_t element, VkDescriptorType type, const DescriptorInfo& info);
+    void FlushDescriptors() const;
+
     [[nodiscard]] inline VkPipelineBindPoint GetBindPoint() const
     {
         switch(m_createInfo.type)
@@ -145,13 +221,55 @@ private:
     VkPipelineLayout m_layout;
 
     bool m_usesDescriptorSet = false;
+    bool m_usesBindlessHeap  = false;
 
     std::vector<VkVertexInputAttributeDescription> m_vertexInputAttributes;
     std::optional<VkVertexInputBindingDescription> m_vertexInputBinding;  // only support one for now
 
+    // the shaders' ranges merged so overlapping ones become a single range with every stage that uses it.
+    // The data is shared by all shaders (they write into it directly) so each range gets pushed once per bind
+    std::vector<VkPushConstantRange> m_pushConstantRanges;
+    std::vector<uint8_t> m_pushConstantData;
+
     SBT m_sbt;
     Buffer m_sbtBuffer;
 
     std::vector<VkDescriptorSetLayout> m_descriptorLayouts;
     std::vector<std::vector<VkDescriptorSet>> m_descriptorSets;
+
+    // descriptor updates are deferred until the pipeline gets bound so that they all go through a single vkUpdateDescriptorSets
+    mutable DescriptorWriter m_descriptorWriter;
+    mutable DescriptorWriter m_pushDescriptorWriter;
+
+    std::vector<DescriptorSetTemplate> m_descriptorTemplates;                  // one per set
+    mutable std::vector<std::vector<DescriptorSetShadow>> m_descriptorShadows;  // [frame][set]
+
+    std::vector<std::vector<DescriptorBufferSet>> m_descriptorBufferSets;  // [frame][set], only with useDescriptorBuffer
+
+    struct Specialization
+    {
+        std::vector<VkSpecializationMapEntry> entries;
+        std::vector<uint32_t> data;
+        VkSpecializationInfo info;
+    };
+    std::vector<Specialization> m_specializations;  // one per shader, only kept while the pipeline is being created
+
+    // kept here rather than in the shader since a shader can be shared by pipelines with different specializations
+    std::array<uint32_t, 3> m_threadGroupSize = {1, 1, 1};
+
+    struct PendingWrite
+    {
+        uint32_t frameIndex;
+        uint32_t set;
+        uint32_t binding;
+        uint32_t element;
+        VkDescriptorType type;
+        DescriptorInfo info;
+    };
+
+    // only set to true after the pending writes have been applied, so everything after that can write directly
+    std::atomic<bool> m_ready = false;
+    std::shared_future<void> m_readyFuture;
+    std::mutex m_pendingWritesMutex;
+    std::vector<PendingWrite> m_pendingWrites;
 };
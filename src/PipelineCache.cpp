@@ -0,0 +1,156 @@
+#include "PipelineCache.hpp"
+#include "Log.hpp"
+#include "ThreadPool.hpp"
+#include <cstring>
+#include <fstream>
+
+PipelineCache::PipelineCache(std::filesystem::path path) : m_path(std::move(path))
+{
+    std::vector<uint8_t> data = Load();
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType                     = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize           = data.size();
+    createInfo.pInitialData              = data.data();
+    VK_CHECK(vkCreatePipelineCache(VulkanContext::GetDevice(), &createInfo, nullptr, &m_cache), "Failed to create pipeline cache");
+
+    m_savedSize = data.size();
+    if(!data.empty())
+        Log::Info("Loaded pipeline cache {} ({} bytes)", m_path.string(), data.size());
+}
+
+PipelineCache::~PipelineCache()
+{
+    if(m_pendingSave.valid())
+        m_pendingSave.wait();
+    Save();
+    vkDestroyPipelineCache(VulkanContext::GetDevice(), m_cache, nullptr);
+}
+
+void PipelineCache::Save()
+{
+    // the cache only ever grows, so an unchanged size means nothing new got compiled
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(VulkanContext::GetDevice(), m_cache, &size, nullptr), "Failed to get pipeline cache size");
+    if(size == 0 || size == m_savedSize)
+        return;
+
+    std::vector<uint8_t> data(size);
+    VK_CHECK(vkGetPipelineCacheData(VulkanContext::GetDevice(), m_cache, &size, data.data()), "Failed to get pipeline cache data");
+
+    FileHeader header = CreateFileHeader();
+    header.dataSize   = size;
+
+    // write next to it and rename so a crash while saving doesn't leave a truncated cache behind
+    std::filesystem::path tmpPath = m_path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if(!file)
+        {
+            Log::Warn("Failed to open {} for writing, pipeline cache not saved", tmpPath.string());
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(size));
+        if(!file)
+        {
+            Log::Warn("Failed to write pipeline cache to {}", tmpPath.string());
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, m_path, ec);
+    if(ec)
+    {
+        Log::Warn("Failed to move pipeline cache to {}: {}", m_path.string(), ec.message());
+        return;
+    }
+    m_savedSize = size;
+}
+
+void PipelineCache::Update(float dt)
+{
+    m_saveTimer += dt;
+    if(m_saveTimer < SAVE_INTERVAL)
+        return;
+    m_saveTimer = 0.0f;
+
+    // the previous save is still writing, try again next interval
+    if(m_pendingSave.valid() && m_pendingSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    // getting the data and writing it can take a while for big caches, so keep it off the render thread
+    if(ThreadPool* threadPool = VulkanContext::GetThreadPool())
+        m_pendingSave = threadPool->Submit([this]() { Save(); });
+    else
+        Save();
+}
+
+PipelineCache::FileHeader PipelineCache::CreateFileHeader() const
+{
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &idProperties;
+    vkGetPhysicalDeviceProperties2(VulkanContext::GetPhysicalDevice(), &properties2);
+
+    FileHeader header{};
+    header.magic         = MAGIC;
+    header.driverVersion = properties2.properties.driverVersion;
+    std::memcpy(header.deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+    return header;
+}
+
+std::vector<uint8_t> PipelineCache::Load() const
+{
+    std::ifstream file(m_path, std::ios::binary | std::ios::ate);
+    if(!file)
+        return {};
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    FileHeader header{};
+    if(fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    {
+        Log::Warn("Pipeline cache {} is truncated, ignoring it", m_path.string());
+        return {};
+    }
+
+    FileHeader expected = CreateFileHeader();
+    if(header.magic != expected.magic || header.driverVersion != expected.driverVersion || std::memcmp(header.deviceUUID, expected.deviceUUID, VK_UUID_SIZE) != 0)
+    {
+        Log::Info("Pipeline cache {} was created by a different device or driver, ignoring it", m_path.string());
+        return {};
+    }
+    if(header.dataSize != fileSize - sizeof(header))
+    {
+        Log::Warn("Pipeline cache {} has the wrong size, ignoring it", m_path.string());
+        return {};
+    }
+
+    std::vector<uint8_t> data(header.dataSize);
+    if(!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())))
+    {
+        Log::Warn("Failed to read pipeline cache {}", m_path.string());
+        return {};
+    }
+
+    // the driver checks this too, but a mismatch there would only show up as a validation error
+    VkPipelineCacheHeaderVersionOne vkHeader{};
+    if(data.size() < sizeof(vkHeader))
+        return {};
+    std::memcpy(&vkHeader, data.data(), sizeof(vkHeader));
+    VkPhysicalDeviceProperties gpuProperties;
+    vkGetPhysicalDeviceProperties(VulkanContext::GetPhysicalDevice(), &gpuProperties);
+    if(vkHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || vkHeader.vendorID != gpuProperties.vendorID || vkHeader.deviceID != gpuProperties.deviceID
+       || std::memcmp(vkHeader.pipelineCacheUUID, gpuProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+    {
+        Log::Info("Pipeline cache {} doesn't match the device, ignoring it", m_path.string());
+        return {};
+    }
+    return data;
+}
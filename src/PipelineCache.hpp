@@ -0,0 +1,47 @@
+#pragma once
+
+#include "VulkanContext.hpp"
+#include <filesystem>
+#include <future>
+
+// VkPipelineCache that survives restarts. The file starts with a small header of our own (device UUID and driver version)
+// so a cache written by another GPU or driver gets thrown away instead of handed to the driver.
+// vkCreate*Pipelines is internally synchronized on the cache, so every thread can share this one
+class PipelineCache
+{
+public:
+    static constexpr float SAVE_INTERVAL = 30.0f;  // seconds
+
+    PipelineCache(std::filesystem::path path);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache& other)            = delete;
+    PipelineCache& operator=(const PipelineCache& other) = delete;
+
+    // writes the cache back to disk if the driver added something since the last save
+    void Save();
+    // called every frame by the renderer, saves every SAVE_INTERVAL seconds on the thread pool
+    void Update(float dt);
+
+    [[nodiscard]] VkPipelineCache GetVkPipelineCache() const { return m_cache; }
+
+private:
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t driverVersion;
+        uint8_t deviceUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+    };
+    static constexpr uint32_t MAGIC = 0x43504b56;  // "VKPC"
+
+    [[nodiscard]] FileHeader CreateFileHeader() const;
+    [[nodiscard]] std::vector<uint8_t> Load() const;
+
+    std::filesystem::path m_path;
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+
+    size_t m_savedSize = 0;
+    float m_saveTimer  = 0.0f;
+    std::future<void> m_pendingSave;
+};
@@ -0,0 +1,137 @@
+#include "PipelineManager.hpp"
+#include "Renderer.hpp"
+#include "Shader.hpp"
+#include "Log.hpp"
+#include <fstream>
+#include <sstream>
+
+std::shared_ptr<Pipeline> PipelineManager::Get(const std::string& name, const std::vector<ShaderSource>& shaders, PipelineCreateInfo createInfo, bool async)
+{
+    std::string key = CreateKey(shaders, createInfo);
+    {
+        std::scoped_lock lock(m_mutex);
+        auto it = m_pipelines.find(key);
+        if(it != m_pipelines.end())
+        {
+            it->second.unusedFrames = 0;
+            return it->second.pipeline;
+        }
+    }
+
+    // this is the expensive part even with async, which only moves the vkCreate*Pipelines call off this thread
+    createInfo.shaders.clear();
+    for(const auto& shader : shaders)
+        createInfo.shaders.push_back(std::make_shared<Shader>(shader.path, shader.stage, shader.entryPoint, shader.options));
+
+    std::shared_ptr<Pipeline> pipeline;
+    if(async)
+        pipeline = Pipeline::CreateAsync(name, std::move(createInfo));
+    else
+        pipeline = std::make_shared<Pipeline>(name, std::move(createInfo));
+
+    // another thread may have created the same pipeline meanwhile, keep the one that got in first so there is only ever one per key
+    std::scoped_lock lock(m_mutex);
+    auto it                 = m_pipelines.try_emplace(std::move(key), Entry{.pipeline = pipeline, .shaders = shaders}).first;
+    it->second.unusedFrames = 0;
+    return it->second.pipeline;
+}
+
+void PipelineManager::CollectGarbage()
+{
+    std::scoped_lock lock(m_mutex);
+    std::erase_if(m_pipelines, [](auto& item) {
+        Entry& entry = item.second;
+        if(entry.pipeline.use_count() > 1)
+        {
+            entry.unusedFrames = 0;
+            return false;
+        }
+        // the last frames that used it might still be in flight
+        return ++entry.unusedFrames > static_cast<uint32_t>(Renderer::MAX_FRAMES_IN_FLIGHT);
+    });
+}
+
+size_t PipelineManager::GetPipelineCount() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_pipelines.size();
+}
+
+std::string PipelineManager::CreateKey(const std::vector<ShaderSource>& shaders, const PipelineCreateInfo& createInfo)
+{
+    std::string key;
+    for(const auto& shader : shaders)
+    {
+        const ShaderCompileOptions& options = shader.options;
+
+        key += std::format("{}|{}|{}|{:x}|{}|", shader.path.string(), static_cast<uint32_t>(shader.stage), shader.entryPoint, GetFileHash(shader.path),
+                           static_cast<int>(options.profile.value_or(Shader::GetDefaultCompileProfile())));
+        for(const auto& define : options.defines)
+            key += std::format("d{}={},", define.name, define.value);
+        for(const auto& constant : options.linkConstants)
+            key += std::format("l{}:{}={},", constant.name, constant.type, constant.value);
+        if(!options.source.empty())
+            key += std::format("s{:x},", std::hash<std::string>{}(options.source));
+        for(const auto& module : options.modules)
+            key += std::format("m{}={:x},", module.name, std::hash<std::string>{}(module.source));
+        key += std::format("{};", options.spirvCachePath.string());
+    }
+
+    key += std::format("{}|{}|{}|{}|{}|{}|{}|{}|{}|{}|",
+                       static_cast<int>(createInfo.type),
+                       createInfo.allowDerivatives,
+                       static_cast<const void*>(createInfo.parent),
+                       createInfo.useColor,
+                       createInfo.useDepth,
+                       createInfo.useStencil,
+                       createInfo.useColorBlend,
+                       createInfo.useMultiSampling,
+                       createInfo.useTesselation,
+                       createInfo.useDynamicViewport);
+    for(auto format : createInfo.colorFormats)
+        key += std::format("{},", static_cast<int>(format));
+    key += std::format("|{}|{}|{}x{}|{}|{}|{}|{}|{}|{}|{}|{}|{}",
+                       static_cast<int>(createInfo.depthFormat),
+                       static_cast<int>(createInfo.stencilFormat),
+                       createInfo.viewportExtent.width,
+                       createInfo.viewportExtent.height,
+                       static_cast<int>(createInfo.msaaSamples),
+                       createInfo.depthWriteEnable,
+                       static_cast<int>(createInfo.depthCompareOp),
+                       createInfo.depthClampEnable,
+                       createInfo.viewMask,
+                       createInfo.isGlobal,
+                       createInfo.pushDescriptorSet ? static_cast<int64_t>(*createInfo.pushDescriptorSet) : -1,
+                       createInfo.useDescriptorBuffer,
+                       static_cast<const void*>(createInfo.fallback));
+    for(const auto& [name, value] : createInfo.specializationConstants)
+        key += std::format("|{}={}", name, value);
+    return key;
+}
+
+size_t PipelineManager::GetFileHash(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    auto lastWriteTime = std::filesystem::last_write_time(path, ec);
+    if(!ec)
+    {
+        std::scoped_lock lock(m_fileHashMutex);
+        auto it = m_fileHashes.find(path.string());
+        if(it != m_fileHashes.end() && it->second.lastWriteTime == lastWriteTime)
+            return it->second.hash;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if(!file)
+        Log::Warn("Can't read shader {} to hash it", path.string());
+    std::stringstream content;
+    content << file.rdbuf();
+    size_t hash = std::hash<std::string>{}(content.str());
+
+    if(!ec)
+    {
+        std::scoped_lock lock(m_fileHashMutex);
+        m_fileHashes[path.string()] = FileHash{.lastWriteTime = lastWriteTime, .hash = hash};
+    }
+    return hash;
+}
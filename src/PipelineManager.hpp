@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Pipeline.hpp"
+#include "Shader.hpp"
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Hands out shared pipelines: asking twice for the same shader sources and PipelineCreateInfo returns the same Pipeline
+// instead of compiling it again. Pipelines nobody holds anymore get destroyed once the GPU can't be using them.
+// Since it knows the sources of every pipeline this is also where hot reloading will hook in
+class PipelineManager
+{
+public:
+    struct ShaderSource
+    {
+        std::filesystem::path path;
+        VkShaderStageFlagBits stage;
+        std::string entryPoint = "main";
+        ShaderCompileOptions options;  // part of the key, so the same file with other defines or modules is its own pipeline
+    };
+
+    PipelineManager() = default;
+
+    PipelineManager(const PipelineManager& other)            = delete;
+    PipelineManager& operator=(const PipelineManager& other) = delete;
+
+    // createInfo.shaders gets filled from shaders. Only the content of the files themselves is hashed, not the modules they import
+    // from disk. Compiling happens without holding the lock, so other threads can still get their pipelines meanwhile.
+    // async only covers the driver side (see Pipeline::CreateAsync): the Slang compile of every shader still runs on the calling
+    // thread, since the shaders' reflection has to exist for parameters to be set before the pipeline is ready. Call Get from a
+    // worker to keep a new pipeline from stalling the frame completely
+    std::shared_ptr<Pipeline> Get(const std::string& name, const std::vector<ShaderSource>& shaders, PipelineCreateInfo createInfo, bool async = false);
+
+    // called by the renderer once per frame
+    void CollectGarbage();
+
+    [[nodiscard]] size_t GetPipelineCount() const;
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<Pipeline> pipeline;
+        std::vector<ShaderSource> shaders;
+        uint32_t unusedFrames = 0;
+    };
+
+    struct FileHash
+    {
+        std::filesystem::file_time_type lastWriteTime;
+        size_t hash;
+    };
+
+    std::string CreateKey(const std::vector<ShaderSource>& shaders, const PipelineCreateInfo& createInfo);
+    // the content hash of a file, only read again when its modification time changed
+    size_t GetFileHash(const std::filesystem::path& path);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_pipelines;
+
+    std::mutex m_fileHashMutex;
+    std::unordered_map<std::string, FileHash> m_fileHashes;  // by path
+};
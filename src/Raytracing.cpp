@@ -3,6 +3,31 @@
 
 namespace Raytracing
 {
+static VkTransformMatrixKHR ToVkTransform(const glm::mat4& m)
+{
+    // Vulkan expects a row-major 3x4 matrix stored as 12 floats:
+    // { m00 m01 m02 m03, m10 m11 m12 m13, m20 m21 m22 m23 }
+    // clang-format off
+    VkTransformMatrixKHR t{};
+    t.matrix[0][0] = m[0][0]; t.matrix[0][1] = m[1][0]; t.matrix[0][2] = m[2][0]; t.matrix[0][3] = m[3][0];
+    t.matrix[1][0] = m[0][1]; t.matrix[1][1] = m[1][1]; t.matrix[1][2] = m[2][1]; t.matrix[1][3] = m[3][1];
+    t.matrix[2][0] = m[0][2]; t.matrix[2][1] = m[1][2]; t.matrix[2][2] = m[2][2]; t.matrix[2][3] = m[3][2];
+    // clang-format on
+    return t;
+}
+
+// Takes positions stored relative to the mesh bounds back to object space
+static VkTransformMatrixKHR ToVkTransform(const PositionQuantization& q)
+{
+    // clang-format off
+    VkTransformMatrixKHR t{};
+    t.matrix[0][0] = q.scale.x; t.matrix[0][3] = q.offset.x;
+    t.matrix[1][1] = q.scale.y; t.matrix[1][3] = q.offset.y;
+    t.matrix[2][2] = q.scale.z; t.matrix[2][3] = q.offset.z;
+    // clang-format on
+    return t;
+}
+
 BLAS CreateBLAS(const Model& model)
 {
     size_t numPrimitives = 0;
@@ -38,6 +63,22 @@ BLAS CreateBLAS(const Model& model)
     const uint32_t scratchAlignment          = accelerationProperties.minAccelerationStructureScratchOffsetAlignment;
     const size_t accelerationOffsetAlignment = 256;
 
+    // VertexFormat::COMPACT positions are snorm16 (the w component is ignored), the build applies the quantization of each
+    // mesh as the transform of its geometries so the BLAS ends up in object space like with float positions
+    const bool quantized = model.GetVertexFormat() == VertexFormat::COMPACT;
+    Buffer quantizationTransforms;
+    if(quantized)
+    {
+        std::vector<VkTransformMatrixKHR> transforms;
+        transforms.reserve(model.GetMeshes().size());
+        for(const auto& mesh : model.GetMeshes())
+            transforms.push_back(ToVkTransform(mesh.quantization));
+
+        quantizationTransforms.Allocate(transforms.size() * sizeof(VkTransformMatrixKHR), VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, true, 16);
+        quantizationTransforms.Fill(transforms);
+    }
+
+    size_t meshIndex = 0;
     for(const auto& mesh : model.GetMeshes())
     {
         std::vector<uint32_t> maxPrimitiveCounts{};
@@ -60,12 +101,14 @@ BLAS CreateBLAS(const Model& model)
             geometry.flags                           = VK_GEOMETRY_OPAQUE_BIT_KHR;
             geometry.geometryType                    = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
             geometry.geometry.triangles.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-            geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+            geometry.geometry.triangles.vertexFormat = quantized ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
             geometry.geometry.triangles.vertexData   = vertexBufferDeviceAddress;
-            geometry.geometry.triangles.maxVertex    = model.GetVertexBuffer().GetSize() / Model::VERTEX_SIZE;
-            geometry.geometry.triangles.vertexStride = Model::VERTEX_SIZE;
+            geometry.geometry.triangles.maxVertex    = model.GetVertexBuffer().GetSize() / model.GetVertexSize();
+            geometry.geometry.triangles.vertexStride = model.GetVertexSize();
             geometry.geometry.triangles.indexType    = VK_INDEX_TYPE_UINT32;
             geometry.geometry.triangles.indexData    = indexBufferDeviceAddress;
+            if(quantized)
+                geometry.geometry.triangles.transformData.deviceAddress = quantizationTransforms.GetDeviceAddress();
 
 
             uint32_t primitiveCount  = primitive.indexBufferSize / (3 * sizeof(uint32_t));
@@ -77,7 +120,7 @@ BLAS CreateBLAS(const Model& model)
             r.firstVertex     = 0;  // you use device-addressed vertex/index buffers with offsets
             r.primitiveOffset = 0;
             r.primitiveCount  = primitiveCount;
-            r.transformOffset = 0;
+            r.transformOffset = quantized ? static_cast<uint32_t>(meshIndex * sizeof(VkTransformMatrixKHR)) : 0;
             ranges.push_back(r);
         }
         buildRangeInfoArrays.push_back(std::move(ranges));
@@ -109,6 +152,7 @@ BLAS CreateBLAS(const Model& model)
         totalAccelerationSize  = (totalAccelerationSize + sizeInfo.accelerationStructureSize + accelerationOffsetAlignment - 1) & ~(accelerationOffsetAlignment - 1);
         totalPrimitiveCount   += meshTriangleCount;
         maxScratchSize         = std::max(maxScratchSize, size_t(sizeInfo.buildScratchSize));
+        ++meshIndex;
     }
 
     for(auto& arr : buildRangeInfoArrays)
@@ -179,19 +223,6 @@ BLAS CreateBLAS(const Model& model)
 
     return blas;
 }
-static VkTransformMatrixKHR ToVkTransform(const glm::mat4& m)
-{
-    // Vulkan expects a row-major 3x4 matrix stored as 12 floats:
-    // { m00 m01 m02 m03, m10 m11 m12 m13, m20 m21 m22 m23 }
-    // clang-format off
-    VkTransformMatrixKHR t{};
-    t.matrix[0][0] = m[0][0]; t.matrix[0][1] = m[1][0]; t.matrix[0][2] = m[2][0]; t.matrix[0][3] = m[3][0];
-    t.matrix[1][0] = m[0][1]; t.matrix[1][1] = m[1][1]; t.matrix[1][2] = m[2][1]; t.matrix[1][3] = m[3][1];
-    t.matrix[2][0] = m[0][2]; t.matrix[2][1] = m[1][2]; t.matrix[2][2] = m[2][2]; t.matrix[2][3] = m[3][2];
-    // clang-format on
-    return t;
-}
-
 TLAS CreateTLAS(const BLAS& blas, const Model& model)
 {
     TLAS tlas;
@@ -310,6 +341,9 @@ TLAS CreateTLAS(const BLAS& blas, const Model& model)
     VK_SET_DEBUG_NAME(tlas.handle, VK_OBJECT_TYPE_ACCELERATION_STRUCTURE_KHR, "TLAS");
     VK_SET_DEBUG_NAME(tlas.buffer.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, "TLAS buffer");
 
+    if(BindlessHeap* heap = VulkanContext::GetBindlessHeap())
+        tlas.bindlessIndex = heap->RegisterAccelerationStructure(tlas.handle);
+
     return tlas;
 }
 
@@ -20,9 +20,13 @@ struct TLAS
 {
     VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
     Buffer buffer;
+    uint32_t bindlessIndex = BindlessHeap::INVALID_INDEX;
 
     void Destroy()
     {
+        if(BindlessHeap* heap = VulkanContext::GetBindlessHeap())
+            heap->Release(BindlessHeap::ACCELERATION_STRUCTURE, bindlessIndex);
+        bindlessIndex = BindlessHeap::INVALID_INDEX;
         vkDestroyAccelerationStructureKHR(VulkanContext::GetDevice(), handle, nullptr);
     }
 };
@@ -17,6 +17,8 @@
 #include <backends/imgui_impl_vulkan.h>
 #include <backends/imgui_impl_glfw.h>
 #include <array>
+#include <algorithm>
+#include <string_view>
 
 #define VOLK_IMPLEMENTATION
 #include <volk.h>
@@ -61,6 +63,37 @@ Renderer::Renderer(const std::shared_ptr<Window>& window) : m_window(window)
 
     CreateCommandPool();
     CreateDescriptorPool();
+
+    // before any other buffer gets created, uniform and storage buffers only get a device address while this exists
+    if(m_supportsDescriptorBuffer)
+    {
+        m_descriptorBuffer                = std::make_unique<DescriptorBuffer>();
+        VulkanContext::m_descriptorBuffer = m_descriptorBuffer.get();
+    }
+
+    m_pipelineCache                = std::make_unique<PipelineCache>("pipeline_cache.bin");
+    VulkanContext::m_pipelineCache = m_pipelineCache->GetVkPipelineCache();
+
+    m_threadPool                = std::make_unique<ThreadPool>();
+    VulkanContext::m_threadPool = m_threadPool.get();
+
+    m_pipelineManager                = std::make_unique<PipelineManager>();
+    VulkanContext::m_pipelineManager = m_pipelineManager.get();
+
+    m_indirectDispatch                = std::make_unique<IndirectDispatch>();
+    VulkanContext::m_indirectDispatch = m_indirectDispatch.get();
+
+    m_textureCache                = std::make_unique<TextureCache>();
+    VulkanContext::m_textureCache = m_textureCache.get();
+
+    // needs to exist before any image or buffer gets created since they register themselves in it
+    m_bindlessHeap                = std::make_unique<BindlessHeap>(*this);
+    VulkanContext::m_bindlessHeap = m_bindlessHeap.get();
+
+    // its placeholder image registers itself in the bindless heap
+    m_textureStreamer                = std::make_unique<TextureStreamer>();
+    VulkanContext::m_textureStreamer = m_textureStreamer.get();
+
     CreateSwapchain();
 
     CreateCommandBuffers();
@@ -74,8 +107,22 @@ Renderer::Renderer(const std::shared_ptr<Window>& window) : m_window(window)
 
 Renderer::~Renderer()
 {
+    // finishes whatever is still queued, e.g. async pipelines. Those tasks can still submit more work through the context
+    m_threadPool->WaitIdle();
+    VulkanContext::m_threadPool = nullptr;
+    m_threadPool.reset();
+
     vkDeviceWaitIdle(VulkanContext::GetDevice());
 
+    VulkanContext::m_pipelineManager = nullptr;
+    m_pipelineManager.reset();
+    VulkanContext::m_indirectDispatch = nullptr;
+    m_indirectDispatch.reset();
+    VulkanContext::m_textureCache = nullptr;
+    m_textureCache.reset();
+    VulkanContext::m_textureStreamer = nullptr;
+    m_textureStreamer.reset();
+
     m_samplers.clear();
 
     for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
@@ -90,6 +137,16 @@ Renderer::~Renderer()
 
     CleanupSwapchain();
 
+    VulkanContext::m_bindlessHeap = nullptr;
+    m_bindlessHeap.reset();
+    VulkanContext::m_descriptorBuffer = nullptr;
+    m_descriptorBuffer.reset();
+    VulkanContext::m_descriptorAllocator = nullptr;
+    m_descriptorAllocator.reset();
+    VulkanContext::m_descriptorLayoutCache = nullptr;
+    m_descriptorLayoutCache.reset();
+    VulkanContext::m_pipelineCache = VK_NULL_HANDLE;
+    m_pipelineCache.reset();
 
     vkDestroyDescriptorPool(VulkanContext::GetDevice(), VulkanContext::GetDescriptorPool(), nullptr);
 
@@ -223,6 +280,42 @@ void Renderer::CreateDevice()
     }
 
 
+    // optional extensions, only enabled if the device has them
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(VulkanContext::GetPhysicalDevice(), nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(VulkanContext::GetPhysicalDevice(), nullptr, &extensionCount, availableExtensions.data());
+    auto extensionAvailable = [&](std::string_view name)
+    { return std::ranges::any_of(availableExtensions, [&](const VkExtensionProperties& e) { return std::string_view(e.extensionName) == name; }); };
+    bool descriptorBufferAvailable = extensionAvailable(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+
+    VulkanContext::m_supportsPushDescriptors = extensionAvailable(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if(VulkanContext::m_supportsPushDescriptors)
+        deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    else
+        Log::Warn("VK_KHR_push_descriptor isn't supported, push descriptor sets will be regular sets");
+
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+    descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+    if(descriptorBufferAvailable)
+    {
+        VkPhysicalDeviceFeatures2 supportedFeatures = {};
+        supportedFeatures.sType                     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext                     = &descriptorBufferFeatures;
+        vkGetPhysicalDeviceFeatures2(VulkanContext::GetPhysicalDevice(), &supportedFeatures);
+        m_supportsDescriptorBuffer = descriptorBufferFeatures.descriptorBuffer;
+    }
+    if(m_supportsDescriptorBuffer)
+        deviceExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+    else
+        Log::Warn("VK_EXT_descriptor_buffer isn't supported, pipelines will use descriptor sets");
+
+    // only enable what we use
+    descriptorBufferFeatures                  = {};
+    descriptorBufferFeatures.sType            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+    descriptorBufferFeatures.descriptorBuffer = true;
+
+
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 
     uint32_t queueFamilyIndex = -1;
@@ -262,6 +355,12 @@ void Renderer::CreateDevice()
     deviceFeatures.shaderInt64                          = true;
     deviceFeatures.shaderFloat64                        = true;
 
+    // KTX2 textures get transcoded to whichever of these the device has
+    VkPhysicalDeviceFeatures availableFeatures;
+    vkGetPhysicalDeviceFeatures(VulkanContext::GetPhysicalDevice(), &availableFeatures);
+    deviceFeatures.textureCompressionBC       = availableFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionASTC_LDR = availableFeatures.textureCompressionASTC_LDR;
+
     VkPhysicalDeviceVulkan11Features device11Features = {};
     device11Features.sType                            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
     device11Features.shaderDrawParameters             = true;
@@ -272,7 +371,10 @@ void Renderer::CreateDevice()
     // these are for dynamic descriptor indexing
     deviceFeatures.shaderSampledImageArrayDynamicIndexing          = true;
     deviceFeatures.shaderStorageBufferArrayDynamicIndexing         = true;
+    deviceFeatures.shaderStorageImageArrayDynamicIndexing          = true;
     device12Features.shaderSampledImageArrayNonUniformIndexing     = true;
+    device12Features.shaderStorageBufferArrayNonUniformIndexing    = true;
+    device12Features.shaderStorageImageArrayNonUniformIndexing     = true;
     device12Features.runtimeDescriptorArray                        = true;
     device12Features.descriptorBindingPartiallyBound               = true;
     device12Features.descriptorBindingUpdateUnusedWhilePending     = true;
@@ -287,7 +389,7 @@ void Renderer::CreateDevice()
     VkPhysicalDeviceVulkan13Features device13Features = {};
     device13Features.sType                            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
     device13Features.dynamicRendering                 = true;
-    device13Features.maintenance4                     = true;  // need it because the spirv compiler uses localsizeid even though it doesnt need to for now, but i might switch to spec constants in the future anyway
+    device13Features.maintenance4                     = true;  // the spirv compiler uses localsizeid, which is also what lets the thread group size be a spec constant
     device13Features.synchronization2                 = true;
 
     VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
@@ -342,6 +444,11 @@ void Renderer::CreateDevice()
         rayQueryFeatures.pNext = &raytracingValidation;
     }
 #endif
+    if(m_supportsDescriptorBuffer)
+    {
+        descriptorBufferFeatures.pNext = createInfo.pNext;
+        createInfo.pNext               = &descriptorBufferFeatures;
+    }
 
     VK_CHECK(vkCreateDevice(VulkanContext::GetPhysicalDevice(), &createInfo, nullptr, &VulkanContext::m_device), "Failed to create device");
     vkGetDeviceQueue(VulkanContext::GetDevice(), queueFamilyIndex, 0, &VulkanContext::m_queue);
@@ -494,28 +601,23 @@ void Renderer::CreateSyncObjects()
 
 void Renderer::CreateDescriptorPool()
 {
-    std::array<VkDescriptorPoolSize, 6> poolSizes = {};
-    poolSizes[0].type                             = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[0].descriptorCount                  = NUM_DESCRIPTORS;
-    poolSizes[1].type                             = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    poolSizes[1].descriptorCount                  = NUM_DESCRIPTORS;
-    poolSizes[2].type                             = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    poolSizes[2].descriptorCount                  = NUM_DESCRIPTORS;
-    poolSizes[3].type                             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[3].descriptorCount                  = NUM_DESCRIPTORS;
-    poolSizes[4].type                             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[4].descriptorCount                  = NUM_DESCRIPTORS;
-    poolSizes[5].type                             = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-    poolSizes[5].descriptorCount                  = 10;
-
+    // only ImGui allocates from this pool (font atlas and textures shown with ImGui::Image), pipelines go through the DescriptorAllocator
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type                 = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount      = IMGUI_DESCRIPTORS;
 
     VkDescriptorPoolCreateInfo createInfo = {};
     createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    createInfo.poolSizeCount              = static_cast<uint32_t>(poolSizes.size());
-    createInfo.pPoolSizes                 = poolSizes.data();
-    createInfo.maxSets                    = 100;
-    createInfo.flags                      = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT | VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    createInfo.poolSizeCount              = 1;
+    createInfo.pPoolSizes                 = &poolSize;
+    createInfo.maxSets                    = IMGUI_DESCRIPTORS;
+    createInfo.flags                      = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
     VK_CHECK(vkCreateDescriptorPool(VulkanContext::GetDevice(), &createInfo, nullptr, &VulkanContext::m_descriptorPool), "Failed to create descriptor pool");
+
+    m_descriptorAllocator                  = std::make_unique<DescriptorAllocator>();
+    VulkanContext::m_descriptorAllocator   = m_descriptorAllocator.get();
+    m_descriptorLayoutCache                = std::make_unique<DescriptorLayoutCache>();
+    VulkanContext::m_descriptorLayoutCache = m_descriptorLayoutCache.get();
 }
 
 void Renderer::SetupImgui()
@@ -540,7 +642,7 @@ void Renderer::SetupImgui()
     imguiInitInfo.Device                      = VulkanContext::GetDevice();
     imguiInitInfo.QueueFamily                 = VulkanContext::GetQueueIndex();
     imguiInitInfo.Queue                       = VulkanContext::GetQueue();
-    imguiInitInfo.PipelineCache               = VK_NULL_HANDLE;
+    imguiInitInfo.PipelineCache               = VulkanContext::GetPipelineCache();
     imguiInitInfo.DescriptorPool              = VulkanContext::GetDescriptorPool();
     imguiInitInfo.Allocator                   = nullptr;
     imguiInitInfo.MinImageCount               = MAX_FRAMES_IN_FLIGHT;
@@ -569,6 +671,13 @@ void Renderer::Render(float dt)
     uint32_t imageIndex;
     VkResult result;
     vkWaitForFences(device, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, UINT64_MAX);
+    m_bindlessHeap->BeginFrame(m_currentFrame);
+    m_descriptorAllocator->BeginFrame(m_currentFrame);
+    if(m_descriptorBuffer)
+        m_descriptorBuffer->BeginFrame(m_currentFrame);
+    m_pipelineCache->Update(dt);
+    m_pipelineManager->CollectGarbage();
+    m_textureStreamer->Update();
 
     result = vkAcquireNextImageKHR(device, m_swapchain, UINT64_MAX, m_imageAvailable[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
 
@@ -746,6 +855,7 @@ void Renderer::Render(float dt)
     // ImGui::UpdatePlatformWindows();
     // ImGui::RenderPlatformWindowsDefault(nullptr, (void*)cb.GetCommandBuffer());
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cb.GetCommandBuffer());
+    cb.InvalidateBoundDescriptorSets();
 
     vkCmdEndRendering(cb.GetCommandBuffer());
 
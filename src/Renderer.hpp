@@ -5,6 +5,14 @@
 
 #include "Image.hpp"
 #include "Window.hpp"
+#include "BindlessHeap.hpp"
+#include "DescriptorBuffer.hpp"
+#include "PipelineCache.hpp"
+#include "ThreadPool.hpp"
+#include "PipelineManager.hpp"
+#include "IndirectDispatch.hpp"
+#include "TextureCache.hpp"
+#include "TextureStreamer.hpp"
 #include <functional>
 #include <memory>
 
@@ -20,6 +28,7 @@ public:
     void Enqueue(const std::function<void(CommandBuffer&, Image&, uint32_t, float)>& func) { m_renderCommands.push_back(func); }
 
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+    static constexpr uint32_t IMGUI_DESCRIPTORS = 64;
 
     VkSampler GetSampler(SamplerConfig config);
 
@@ -54,4 +63,18 @@ private:
     std::vector<std::function<void(CommandBuffer&, Image&, uint32_t, float)>> m_renderCommands;
 
     std::unordered_map<SamplerConfig, Sampler> m_samplers;
+
+    std::unique_ptr<DescriptorAllocator> m_descriptorAllocator;
+    std::unique_ptr<DescriptorLayoutCache> m_descriptorLayoutCache;
+    std::unique_ptr<BindlessHeap> m_bindlessHeap;
+
+    bool m_supportsDescriptorBuffer = false;
+    std::unique_ptr<DescriptorBuffer> m_descriptorBuffer;
+
+    std::unique_ptr<PipelineCache> m_pipelineCache;
+    std::unique_ptr<ThreadPool> m_threadPool;
+    std::unique_ptr<PipelineManager> m_pipelineManager;
+    std::unique_ptr<IndirectDispatch> m_indirectDispatch;
+    std::unique_ptr<TextureCache> m_textureCache;
+    std::unique_ptr<TextureStreamer> m_textureStreamer;
 };
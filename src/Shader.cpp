@@ -27,69 +27,190 @@ VkDescriptorType SlangBindingTypeToVulkan(slang::BindingType bindingType);
 
 static Slang::ComPtr<slang::IGlobalSession> globalSession;
 
-Shader::Shader(const std::filesystem::path& path, VkShaderStageFlagBits stage, std::string_view entryPoint)
+#ifdef VDEBUG
+ShaderCompileProfile Shader::s_defaultCompileProfile = ShaderCompileProfile::DEBUG;
+#else
+ShaderCompileProfile Shader::s_defaultCompileProfile = ShaderCompileProfile::RELEASE;
+#endif
+
+static std::vector<slang::CompilerOptionEntry> GetProfileOptions(ShaderCompileProfile profile)
+{
+    auto intOption = [](slang::CompilerOptionName name, int value) -> slang::CompilerOptionEntry
+    { return {name, {slang::CompilerOptionValueKind::Int, value, 0, nullptr, nullptr}}; };
+
+    switch(profile)
+    {
+    case ShaderCompileProfile::DEBUG:
+        // Slang validates the SPIR-V it emits unless told to skip it
+        return {
+            intOption(slang::CompilerOptionName::DebugInformation, SLANG_DEBUG_INFO_LEVEL_MAXIMAL),
+            intOption(slang::CompilerOptionName::Optimization, SLANG_OPTIMIZATION_LEVEL_NONE),
+        };
+    case ShaderCompileProfile::PROFILING:
+        return {
+            intOption(slang::CompilerOptionName::DebugInformation, SLANG_DEBUG_INFO_LEVEL_STANDARD),
+            intOption(slang::CompilerOptionName::Optimization, SLANG_OPTIMIZATION_LEVEL_HIGH),
+            intOption(slang::CompilerOptionName::SkipSPIRVValidation, 1),
+        };
+    case ShaderCompileProfile::RELEASE:
+    default:
+        return {
+            intOption(slang::CompilerOptionName::DebugInformation, SLANG_DEBUG_INFO_LEVEL_NONE),
+            intOption(slang::CompilerOptionName::Optimization, SLANG_OPTIMIZATION_LEVEL_HIGH),
+            intOption(slang::CompilerOptionName::SkipSPIRVValidation, 1),
+        };
+    }
+}
+
+Shader::Shader(const std::filesystem::path& path, VkShaderStageFlagBits stage, std::string_view entryPoint, const ShaderCompileOptions& options)
 {
     m_stage = stage;
 
     m_name = std::format("{}::{}", path.filename().string(), entryPoint);
 
-    if(!Compile(path, entryPoint))
+    if(!Compile(path, entryPoint, options))
     {
         abort();
     }
 }
-void Shader::Finalize(Pipeline* pipeline)
+
+std::shared_ptr<Shader> Shader::Clone() const
 {
-    m_pipeline = pipeline;
+    assert(m_spirv && "Shader has no code to clone");
+
+    std::shared_ptr<Shader> clone(new Shader());
+    clone->m_name  = m_name;
+    clone->m_stage = m_stage;
+    clone->m_spirv = m_spirv;
+
+    clone->m_descriptorLayoutBuilders = m_descriptorLayoutBuilders;
+    clone->m_bindings                 = m_bindings;
+    clone->m_pushConstantRange        = m_pushConstantRange;
+    clone->m_pushConstantSizes        = m_pushConstantSizes;
+
+    clone->m_uniformBufferInfos = m_uniformBufferInfos;
+    clone->m_uniformBufferSize  = m_uniformBufferSize;
+
+    clone->m_numThreadsX             = m_numThreadsX;
+    clone->m_numThreadsY             = m_numThreadsY;
+    clone->m_numThreadsZ             = m_numThreadsZ;
+    clone->m_threadGroupSizeIds      = m_threadGroupSizeIds;
+    clone->m_specializationConstants = m_specializationConstants;
 
+    clone->CreateShaderModule();
+    return clone;
+}
+
+void Shader::CreateShaderModule()
+{
+    VkShaderModuleCreateInfo createInfo = {};
+    createInfo.sType                    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize                 = m_spirv->size() * sizeof(uint32_t);
+    createInfo.pCode                    = m_spirv->data();
+
+    VK_CHECK(vkCreateShaderModule(VulkanContext::GetDevice(), &createInfo, nullptr, &m_shaderModule), "Failed to create shader module");
+}
+void Shader::CreateUniformBuffers()
+{
+    if(m_uniformBufferSize == 0 || !m_uniformBuffers.empty())
+        return;
+
+    for(int i = 0; i < Renderer::MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        const auto& buf = m_uniformBuffers.emplace_back(m_uniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, true);
+        VK_SET_DEBUG_NAME(buf.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, m_name.c_str());
+    }
+}
+
+void Shader::Finalize(Pipeline* pipeline)
+{
     if(m_uniformBufferSize > 0)
     {
-        for(int i = 0; i < Renderer::MAX_FRAMES_IN_FLIGHT; i++)
-        {
-            const auto& buf = m_uniformBuffers.emplace_back(m_uniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, true);
-            VK_SET_DEBUG_NAME(buf.GetVkBuffer(), VK_OBJECT_TYPE_BUFFER, m_name.c_str());
-        }
         for(int i = 0; i < Renderer::MAX_FRAMES_IN_FLIGHT; i++)
         {
             for(const auto& [set, binding, size, offset] : m_uniformBufferInfos)
             {
-                VkWriteDescriptorSet descriptorWrite{};
-                descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descriptorWrite.descriptorCount = 1;
-                descriptorWrite.dstBinding      = binding;
-                descriptorWrite.dstSet          = pipeline->m_descriptorSets[i][set];
-                descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-
-                VkDescriptorBufferInfo bufferInfo{};
-                bufferInfo.buffer = m_uniformBuffers[i].GetVkBuffer();
-                bufferInfo.range  = size;
-                bufferInfo.offset = offset;
+                DescriptorInfo info{};
+                info.buffer.buffer = m_uniformBuffers[i].GetVkBuffer();
+                info.buffer.range  = size;
+                info.buffer.offset = offset;
 
-                descriptorWrite.pBufferInfo = &bufferInfo;
-
-                vkUpdateDescriptorSets(VulkanContext::GetDevice(), 1, &descriptorWrite, 0, nullptr);
+                pipeline->WriteDescriptor(i, set, binding, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, info);
             }
         }
     }
-    m_pushConstantData.resize(m_pushConstantRange.size + m_pushConstantRange.offset);
-}
-void Shader::BindResources(CommandBuffer& cb, uint32_t /* frameIndex */, VkPipelineLayout layout, VkPipelineBindPoint /* bindPoint */) const
-{
-    if(m_pushConstantRange.size > 0)
-        vkCmdPushConstants(cb.GetCommandBuffer(), layout, m_stage, m_pushConstantRange.offset, m_pushConstantRange.size, &m_pushConstantData[m_pushConstantRange.offset]);
 }
 
 void Shader::Dispatch(CommandBuffer& cb, uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ)
 {
     assert(m_stage == VK_SHADER_STAGE_COMPUTE_BIT);
-    uint32_t groupCountX = std::ceil(threadCountX / (float)m_numThreadsX);
-    uint32_t groupCountY = std::ceil(threadCountY / (float)m_numThreadsY);
-    uint32_t groupCountZ = std::ceil(threadCountZ / (float)m_numThreadsZ);
+    const auto groupSize = GetThreadGroupSize();
+    uint32_t groupCountX = std::ceil(threadCountX / (float)groupSize[0]);
+    uint32_t groupCountY = std::ceil(threadCountY / (float)groupSize[1]);
+    uint32_t groupCountZ = std::ceil(threadCountZ / (float)groupSize[2]);
 
     vkCmdDispatch(cb.GetCommandBuffer(), groupCountX, groupCountY, groupCountZ);
 }
 
-bool Shader::Compile(const std::filesystem::path& path, std::string_view entryPoint)
+void Shader::DispatchIndirect(CommandBuffer& cb, const Buffer& buffer, VkDeviceSize offset, uint32_t count, uint32_t stride)
+{
+    assert(m_stage == VK_SHADER_STAGE_COMPUTE_BIT);
+    assert(offset % 4 == 0 && stride % 4 == 0 && "Indirect dispatch offsets have to be 4 byte aligned");
+    assert(count == 0 || offset + (count - 1) * stride + sizeof(VkDispatchIndirectCommand) <= buffer.GetSize());
+
+    for(uint32_t i = 0; i < count; i++)
+        vkCmdDispatchIndirect(cb.GetCommandBuffer(), buffer.GetVkBuffer(), offset + i * stride);
+}
+
+static std::vector<uint32_t> LoadCachedSpirv(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if(!file)
+        return {};
+
+    size_t size = static_cast<size_t>(file.tellg());
+    if(size == 0 || size % sizeof(uint32_t) != 0)
+    {
+        Log::Warn("Cached shader {} has an invalid size, recompiling it", path.string());
+        return {};
+    }
+    file.seekg(0);
+    std::vector<uint32_t> code(size / sizeof(uint32_t));
+    if(!file.read(reinterpret_cast<char*>(code.data()), static_cast<std::streamsize>(size)))
+        return {};
+
+    constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+    if(code[0] != SPIRV_MAGIC)
+    {
+        Log::Warn("Cached shader {} isn't SPIR-V, recompiling it", path.string());
+        return {};
+    }
+    return code;
+}
+
+static void SaveCachedSpirv(const std::filesystem::path& path, const std::vector<uint32_t>& code)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // write next to it and rename so a crash while saving doesn't leave a truncated file behind
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(code.data()), static_cast<std::streamsize>(code.size() * sizeof(uint32_t)));
+        if(!file)
+        {
+            Log::Warn("Failed to write cached shader {}", tmpPath.string());
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if(ec)
+        Log::Warn("Failed to move cached shader to {}: {}", path.string(), ec.message());
+}
+
+bool Shader::Compile(const std::filesystem::path& path, std::string_view entryPoint, const ShaderCompileOptions& options)
 {
     if(!globalSession.get())
         createGlobalSession(globalSession.writeRef());
@@ -110,24 +231,50 @@ bool Shader::Compile(const std::filesystem::path& path, std::string_view entryPo
     sessionDesc.searchPaths               = searchPath.data();
     sessionDesc.searchPathCount           = searchPath.size();
 
-    std::vector<slang::CompilerOptionEntry> options = {
+    std::vector<slang::CompilerOptionEntry> compilerOptions = {
         {
          {slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1, 0, nullptr, nullptr}},
-         {slang::CompilerOptionName::DebugInformation, {slang::CompilerOptionValueKind::Int, SlangDebugInfoLevel::SLANG_DEBUG_INFO_LEVEL_MAXIMAL, 0, nullptr, nullptr}},
          }
     };
-    sessionDesc.compilerOptionEntries    = options.data();
-    sessionDesc.compilerOptionEntryCount = options.size();
+    auto profileOptions = GetProfileOptions(options.profile.value_or(s_defaultCompileProfile));
+    compilerOptions.insert(compilerOptions.end(), profileOptions.begin(), profileOptions.end());
+    sessionDesc.compilerOptionEntries    = compilerOptions.data();
+    sessionDesc.compilerOptionEntryCount = compilerOptions.size();
+
+    std::vector<slang::PreprocessorMacroDesc> macros;
+    for(const auto& define : options.defines)
+        macros.push_back({define.name.c_str(), define.value.c_str()});
+    sessionDesc.preprocessorMacros     = macros.data();
+    sessionDesc.preprocessorMacroCount = macros.size();
 
     Slang::ComPtr<slang::ISession> session;
     globalSession->createSession(sessionDesc, session.writeRef());
 
+    // 2.5 Generated modules, imports look at the modules the session already loaded before searching for files
+    for(const auto& module : options.modules)
+    {
+        Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+        slang::IModule* loaded = session->loadModuleFromSourceString(module.name.c_str(), (module.name + ".slang").c_str(), module.source.c_str(), diagnosticsBlob.writeRef());
+        if(diagnosticsBlob != nullptr)
+        {
+            Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
+        }
+        if(!loaded)
+        {
+            Log::Error("Failed to load the generated module {} of {}", module.name, m_name);
+            return false;
+        }
+    }
+
     // 3. Load module
     std::string path_str = path.filename().string();
     Slang::ComPtr<slang::IModule> slangModule;
     {
         Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-        slangModule = session->loadModule(path_str.c_str(), diagnosticsBlob.writeRef());
+        if(options.source.empty())
+            slangModule = session->loadModule(path_str.c_str(), diagnosticsBlob.writeRef());
+        else
+            slangModule = session->loadModuleFromSourceString(path.stem().string().c_str(), path.string().c_str(), options.source.c_str(), diagnosticsBlob.writeRef());
         if(diagnosticsBlob != nullptr)
         {
             Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
@@ -150,10 +297,34 @@ bool Shader::Compile(const std::filesystem::path& path, std::string_view entryPo
         }
     }
 
+    // 4.5 Link time constants, the module declares them as extern and this one exports the values
+    Slang::ComPtr<slang::IModule> constantsModule;
+    if(!options.linkConstants.empty())
+    {
+        std::string source;
+        for(const auto& constant : options.linkConstants)
+            source += std::format("export static const {} {} = {};\n", constant.type, constant.name, constant.value);
+
+        Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+        auto moduleName = std::format("{}_constants", path.stem().string());
+        constantsModule = session->loadModuleFromSourceString(moduleName.c_str(), (moduleName + ".slang").c_str(), source.c_str(), diagnosticsBlob.writeRef());
+        if(diagnosticsBlob != nullptr)
+        {
+            Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
+        }
+        if(!constantsModule)
+        {
+            Log::Error("Failed to create the link time constants of {}", m_name);
+            return false;
+        }
+    }
+
     // 5. Compose Modules + Entry Points
-    std::array<slang::IComponentType*, 2> componentTypes = {
+    std::vector<slang::IComponentType*> componentTypes = {
         slangModule,
         shaderEntryPoint};
+    if(constantsModule)
+        componentTypes.push_back(constantsModule);
 
     Slang::ComPtr<slang::IComponentType> composedProgram;
     {
@@ -170,58 +341,64 @@ bool Shader::Compile(const std::filesystem::path& path, std::string_view entryPo
         if(result < 0)
             Log::Error("Failed to compose shader program");
     }
-    // 6. Link
-    Slang::ComPtr<slang::IComponentType> linkedProgram;
-    {
-        Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-        SlangResult result = composedProgram->link(
-            linkedProgram.writeRef(),
-            diagnosticsBlob.writeRef());
-        if(diagnosticsBlob != nullptr)
-        {
-            Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
-        }
-        if(result < 0)
-        {
-            Log::Error("Failed to link shader program");
-            return false;
-        }
-    }
 
-    // 7. Get Target Kernel Code
-    Slang::ComPtr<slang::IBlob> spirvCode;
+    // reflection only needs the composed program, so with a cached binary linking and code generation can be skipped
+    std::vector<uint32_t> code;
+    if(!options.spirvCachePath.empty())
+        code = LoadCachedSpirv(options.spirvCachePath);
+
+    if(code.empty())
     {
-        Slang::ComPtr<slang::IBlob> diagnosticsBlob;
-        SlangResult result = linkedProgram->getEntryPointCode(
-            0,
-            0,
-            spirvCode.writeRef(),
-            diagnosticsBlob.writeRef());
-        if(diagnosticsBlob != nullptr)
+        // 6. Link
+        Slang::ComPtr<slang::IComponentType> linkedProgram;
         {
-            Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
+            Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+            SlangResult result = composedProgram->link(
+                linkedProgram.writeRef(),
+                diagnosticsBlob.writeRef());
+            if(diagnosticsBlob != nullptr)
+            {
+                Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
+            }
+            if(result < 0)
+            {
+                Log::Error("Failed to link shader program");
+                return false;
+            }
         }
-        if(result < 0)
+
+        // 7. Get Target Kernel Code
+        Slang::ComPtr<slang::IBlob> spirvCode;
         {
-            Log::Error("Failed to compile shader program");
-            return false;
+            Slang::ComPtr<slang::IBlob> diagnosticsBlob;
+            SlangResult result = linkedProgram->getEntryPointCode(
+                0,
+                0,
+                spirvCode.writeRef(),
+                diagnosticsBlob.writeRef());
+            if(diagnosticsBlob != nullptr)
+            {
+                Log::Error("{}", (const char*)diagnosticsBlob->getBufferPointer());
+            }
+            if(result < 0)
+            {
+                Log::Error("Failed to compile shader program");
+                return false;
+            }
         }
-    }
-    VkShaderModuleCreateInfo createInfo = {};
-    createInfo.sType                    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize                 = spirvCode->getBufferSize();
-    createInfo.pCode                    = (const uint32_t*)spirvCode->getBufferPointer();
+        code.resize(spirvCode->getBufferSize() / sizeof(uint32_t));
+        std::memcpy(code.data(), spirvCode->getBufferPointer(), code.size() * sizeof(uint32_t));
 
+        if(!options.spirvCachePath.empty())
+            SaveCachedSpirv(options.spirvCachePath, code);
+    }
+    m_spirv = std::make_shared<const std::vector<uint32_t>>(std::move(code));
 
-    VK_CHECK(vkCreateShaderModule(VulkanContext::GetDevice(), &createInfo, nullptr, &m_shaderModule), "Failed to create shader module");
+    CreateShaderModule();
     Reflect(composedProgram->getLayout());
+    if(m_stage == VK_SHADER_STAGE_COMPUTE_BIT)
+        ReflectThreadGroupSize(m_spirv->data(), m_spirv->size());
 
-    if(m_stage == VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)
-    {
-        std::ofstream ofs("shaders/test.spv", std::ios::binary);
-        ofs.write(static_cast<const char*>(spirvCode->getBufferPointer()), static_cast<std::streamsize>(spirvCode->getBufferSize()));
-        ofs.flush();
-    }
     return true;
 }
 
@@ -309,7 +486,13 @@ void Shader::GetLayout(slang::VariableLayoutReflection* vl, std::deque<slang::Va
     if(!typeName)
         typeName = "<anon_type>";
 
-    auto category    = vl->getCategory();
+    auto category = vl->getCategory();
+    if(category == slang::ParameterCategory::SpecializationConstant)
+    {
+        m_specializationConstants[GetName(pathStack)] = static_cast<uint32_t>(vl->getOffset(slang::ParameterCategory::SpecializationConstant));
+        pathStack.pop_front();
+        return;
+    }
     BindingSlot slot = CalculateOffset(pathStack, category);
 
 
@@ -386,6 +569,52 @@ void Shader::GetLayout(slang::VariableLayoutReflection* vl, std::deque<slang::Va
 }
 
 
+// Slang declares the thread group size with LocalSizeId, so an axis can point to a specialization constant instead of a literal.
+// Reflection only knows the literal sizes, so this walks the SPIR-V to find the constant ids and their default values
+void Shader::ReflectThreadGroupSize(const uint32_t* code, size_t wordCount)
+{
+    constexpr uint32_t OP_DECORATE           = 71;
+    constexpr uint32_t OP_SPEC_CONSTANT      = 50;
+    constexpr uint32_t OP_EXECUTION_MODE_ID  = 331;
+    constexpr uint32_t DECORATION_SPEC_ID    = 1;
+    constexpr uint32_t EXECUTION_MODE_SIZEID = 38;  // LocalSizeId
+
+    std::optional<std::array<uint32_t, 3>> sizeIds;
+    std::unordered_map<uint32_t, uint32_t> specIds;   // result id -> constant id
+    std::unordered_map<uint32_t, uint32_t> defaults;  // result id -> default value
+
+    // the first 5 words are the header
+    for(size_t i = 5; i < wordCount;)
+    {
+        uint32_t opcode = code[i] & 0xffff;
+        uint32_t length = code[i] >> 16;
+        if(length == 0 || i + length > wordCount)
+            break;
+
+        if(opcode == OP_DECORATE && length >= 4 && code[i + 2] == DECORATION_SPEC_ID)
+            specIds[code[i + 1]] = code[i + 3];
+        else if(opcode == OP_SPEC_CONSTANT && length >= 4)
+            defaults[code[i + 2]] = code[i + 3];
+        else if(opcode == OP_EXECUTION_MODE_ID && length >= 6 && code[i + 2] == EXECUTION_MODE_SIZEID)
+            sizeIds = std::array{code[i + 3], code[i + 4], code[i + 5]};
+
+        i += length;
+    }
+    if(!sizeIds)
+        return;
+
+    std::array<uint32_t*, 3> numThreads = {&m_numThreadsX, &m_numThreadsY, &m_numThreadsZ};
+    for(uint32_t axis = 0; axis < 3; axis++)
+    {
+        auto specId = specIds.find((*sizeIds)[axis]);
+        if(specId == specIds.end())
+            continue;
+        m_threadGroupSizeIds[axis] = specId->second;
+        if(auto value = defaults.find((*sizeIds)[axis]); value != defaults.end())
+            *numThreads[axis] = value->second;
+    }
+}
+
 void Shader::Reflect(slang::ProgramLayout* layout)
 {
     std::deque<slang::VariableLayoutReflection*> pathStack;
@@ -404,9 +633,11 @@ void Shader::Reflect(slang::ProgramLayout* layout)
         m_numThreadsY = numThreads[1];
         m_numThreadsZ = numThreads[2];
     }
+    for(const auto& [name, id] : m_specializationConstants)
+        Log::Info("{:30}: constant_id:{} type: SpecializationConstant", name, id);
 
     {
-        uint32_t totalSize     = 0;
+        uint32_t end           = 0;
         uint32_t initialOffset = std::numeric_limits<uint32_t>::max();
         for(auto& [name, binding] : m_bindings)
         {
@@ -420,11 +651,12 @@ void Shader::Reflect(slang::ProgramLayout* layout)
             }
             binding.offset += baseOffset;
 
-            totalSize     += binding.size;
-            initialOffset  = std::min(static_cast<uint32_t>(binding.offset), initialOffset);
+            // padding between members is part of the range too, so it spans from the first to the end of the last member
+            end           = std::max(static_cast<uint32_t>(binding.offset + binding.size), end);
+            initialOffset = std::min(static_cast<uint32_t>(binding.offset), initialOffset);
         }
-        m_pushConstantRange.size       = totalSize;
-        m_pushConstantRange.offset     = totalSize > 0 ? initialOffset : 0;  // don't add it if no push constants
+        m_pushConstantRange.size       = end > 0 ? end - initialOffset : 0;
+        m_pushConstantRange.offset     = end > 0 ? initialOffset : 0;  // don't add it if no push constants
         m_pushConstantRange.stageFlags = m_stage;
     }
 
@@ -479,7 +711,7 @@ void Shader::Reflect(slang::ProgramLayout* layout)
                 count = binding.arrayElementCount;
             if(binding.isVariableSize)
                 count = 1000;
-            m_descriptorLayoutBuilders[set].AddBinding(binding.binding, binding.type, count);
+            m_descriptorLayoutBuilders[set].AddBinding(binding.binding, binding.type, count, binding.isVariableSize);
             added[set].insert(binding.binding);
         }
     }
@@ -522,25 +754,18 @@ void Shader::SetParameter(uint32_t frameIndex, std::string_view name, const Imag
             return;
         }
 
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.dstBinding      = binding.binding;
-        descriptorWrite.dstSet          = m_pipeline->m_descriptorSets[frameIndex][binding.set];
-        descriptorWrite.descriptorType  = binding.type;
-        descriptorWrite.dstArrayElement = index;
-
-        VkDescriptorImageInfo imageInfo{};
-        imageInfo.imageLayout = image->GetLayout();
-        imageInfo.imageView   = image->GetImageView();
+        // a texture that is still streaming in reports the layout it will have once its upload ran, sample the placeholder until then
+        const Image& source = binding.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ? *image : image->GetSampledSource();
+
+        DescriptorInfo info{};
+        info.image.imageLayout = source.GetLayout();
+        info.image.imageView   = source.GetImageView();
         if(auto sampler = image->GetSamplerConfig())
         {
-            imageInfo.sampler = Application::GetInstance()->GetRenderer()->GetSampler(sampler.value());
+            info.image.sampler = Application::GetInstance()->GetRenderer()->GetSampler(sampler.value());
         }
 
-        descriptorWrite.pImageInfo = &imageInfo;
-
-        vkUpdateDescriptorSets(VulkanContext::GetDevice(), 1, &descriptorWrite, 0, nullptr);
+        m_pipeline->WriteDescriptor(frameIndex, binding.set, binding.binding, index, binding.type, info);
     }
 }
 
@@ -577,22 +802,12 @@ void Shader::SetParameter(uint32_t frameIndex, std::string_view name, const Buff
             return;
         }
 
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.dstBinding      = binding.binding;
-        descriptorWrite.dstSet          = m_pipeline->m_descriptorSets[frameIndex][binding.set];
-        descriptorWrite.descriptorType  = binding.type;
-        descriptorWrite.dstArrayElement = index;
-
-        VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = buffer->GetVkBuffer();
-        bufferInfo.range  = buffer->GetSize();
-        bufferInfo.offset = 0;
+        DescriptorInfo info{};
+        info.buffer.buffer = buffer->GetVkBuffer();
+        info.buffer.range  = buffer->GetSize();
+        info.buffer.offset = 0;
 
-        descriptorWrite.pBufferInfo = &bufferInfo;
-
-        vkUpdateDescriptorSets(VulkanContext::GetDevice(), 1, &descriptorWrite, 0, nullptr);
+        m_pipeline->WriteDescriptor(frameIndex, binding.set, binding.binding, index, binding.type, info);
     }
 }
 
@@ -624,21 +839,10 @@ void Shader::SetParameter(uint32_t frameIndex, std::string_view name, const Rayt
             return;
         }
 
-        VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo{};
-        descriptorAccelerationStructureInfo.sType                      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
-        descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
-        descriptorAccelerationStructureInfo.pAccelerationStructures    = &tlas.handle;
-
-        VkWriteDescriptorSet descriptorWrite{};
-        descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.dstBinding      = binding.binding;
-        descriptorWrite.dstSet          = m_pipeline->m_descriptorSets[frameIndex][binding.set];
-        descriptorWrite.descriptorType  = binding.type;
-        descriptorWrite.dstArrayElement = index;
-        descriptorWrite.pNext           = &descriptorAccelerationStructureInfo;
-
-        vkUpdateDescriptorSets(VulkanContext::GetDevice(), 1, &descriptorWrite, 0, nullptr);
+        DescriptorInfo info{};
+        info.accelerationStructure = tlas.handle;
+
+        m_pipeline->WriteDescriptor(frameIndex, binding.set, binding.binding, index, binding.type, info);
     }
 }
 
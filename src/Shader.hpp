@@ -9,6 +9,9 @@
 #include <filesystem>
 #include <array>
 #include <deque>
+#include <memory>
+#include <optional>
+#include <span>
 #include "Log.hpp"
 #include "Pipeline.hpp"
 
@@ -18,10 +21,49 @@ concept IsAnyOf = (std::same_as<T, U> || ...);
 template<typename T>
 concept IsSimpleParameter = !IsAnyOf<std::remove_cvref_t<std::remove_pointer_t<std::decay_t<T>>>, Buffer, Image, Raytracing::TLAS>;
 
+struct ShaderConstant
+{
+    std::string name;
+    std::string value;
+    std::string type = "int";  // only used for link time constants
+};
+
+// A module that only exists as source, shaders import it by name
+struct ShaderSourceModule
+{
+    std::string name;
+    std::string source;
+};
+
+enum class ShaderCompileProfile
+{
+    DEBUG,      // full debug info, no optimization, SPIR-V validation
+    RELEASE,    // no debug info, optimized, no validation
+    PROFILING,  // optimized but keeps line info so profilers can map back to the source
+};
+
+struct ShaderCompileOptions
+{
+    // Shader::GetDefaultCompileProfile if not set
+    std::optional<ShaderCompileProfile> profile;
+    // preprocessor macros, e.g. {"USE_NORMAL_MAP", "1"}
+    std::vector<ShaderConstant> defines;
+    // values of `extern static const int NAME;` declarations, they get linked in from a generated module
+    // so unlike defines they don't change the source the front end sees
+    std::vector<ShaderConstant> linkConstants;
+    // if set this gets compiled instead of the file at path, the path is still used for the module name and the import search path
+    std::string source;
+    // generated modules the shader imports, e.g. {VERTEX_ACCESSOR_MODULE, GenerateVertexAccessor(model.GetVertexFormat())}
+    std::vector<ShaderSourceModule> modules;
+    // if set the SPIR-V is read from this file instead of being generated, and written to it after generating it.
+    // The path has to change whenever the source or the options do
+    std::filesystem::path spirvCachePath;
+};
+
 class Shader
 {
 public:
-    Shader(const std::filesystem::path& path, VkShaderStageFlagBits stage, std::string_view entryPoint = "main");
+    Shader(const std::filesystem::path& path, VkShaderStageFlagBits stage, std::string_view entryPoint = "main", const ShaderCompileOptions& options = {});
     ~Shader()
     {
         DestroyShaderModule();
@@ -33,6 +75,7 @@ public:
         : m_name(std::move(other.m_name)),
           m_shaderModule(other.m_shaderModule),
           m_stage(other.m_stage),
+          m_spirv(std::move(other.m_spirv)),
 
           m_descriptorLayoutBuilders(std::move(other.m_descriptorLayoutBuilders)),
 
@@ -46,7 +89,9 @@ public:
 
           m_numThreadsX(other.m_numThreadsX),
           m_numThreadsY(other.m_numThreadsY),
-          m_numThreadsZ(other.m_numThreadsZ)
+          m_numThreadsZ(other.m_numThreadsZ),
+          m_threadGroupSizeIds(other.m_threadGroupSizeIds),
+          m_specializationConstants(std::move(other.m_specializationConstants))
     {
         other.m_shaderModule      = VK_NULL_HANDLE;
         other.m_stage             = {};
@@ -62,6 +107,7 @@ public:
             m_name         = std::move(other.m_name);
             m_shaderModule = other.m_shaderModule;
             m_stage        = other.m_stage;
+            m_spirv        = std::move(other.m_spirv);
 
             m_descriptorLayoutBuilders = std::move(other.m_descriptorLayoutBuilders);
 
@@ -77,6 +123,9 @@ public:
             m_numThreadsY = other.m_numThreadsY;
             m_numThreadsZ = other.m_numThreadsZ;
 
+            m_threadGroupSizeIds      = other.m_threadGroupSizeIds;
+            m_specializationConstants = std::move(other.m_specializationConstants);
+
             other.m_shaderModule      = VK_NULL_HANDLE;
             other.m_stage             = {};
             other.m_uniformBufferSize = 0;
@@ -84,8 +133,7 @@ public:
         return *this;
     }
 
-    void BindResources(CommandBuffer& cb, uint32_t frameIndex, VkPipelineLayout layout, VkPipelineBindPoint bindPoint) const;
-
+    // while image is streaming in (see Image::IsReady) this binds its placeholder, set it again once the image is ready
     void SetParameter(uint32_t frameIndex, std::string_view name, const Image* image, uint32_t index = 0);
     void SetParameter(uint32_t frameIndex, std::string_view name, const Buffer* buffer, uint32_t index = 0);
     void SetParameter(uint32_t frameIndex, std::string_view name, const Raytracing::TLAS& tlas, uint32_t index = 0);
@@ -98,12 +146,30 @@ public:
     void SetParameter(uint32_t frameIndex, std::string_view name, const std::vector<T>& data);
 
     void Dispatch(CommandBuffer& cb, uint32_t threadCountX, uint32_t threadCountY, uint32_t threadCountZ);
+    // group counts come from count VkDispatchIndirectCommands in buffer (needs indirect buffer usage) instead of the CPU,
+    // e.g. written by IndirectDispatch::GenerateArgs from a count an earlier pass produced
+    void DispatchIndirect(CommandBuffer& cb, const Buffer& buffer, VkDeviceSize offset = 0, uint32_t count = 1, uint32_t stride = sizeof(VkDispatchIndirectCommand));
+    // the specialized size of the pipeline using this shader, or the reflected one before it got assigned to one
+    [[nodiscard]] std::array<uint32_t, 3> GetThreadGroupSize() const { return m_pipeline ? m_pipeline->GetThreadGroupSize() : std::array<uint32_t, 3>{m_numThreadsX, m_numThreadsY, m_numThreadsZ}; }
+
+    // DEBUG in debug builds and RELEASE otherwise unless overridden. Only affects shaders compiled after the call
+    static void SetDefaultCompileProfile(ShaderCompileProfile profile) { s_defaultCompileProfile = profile; }
+    static ShaderCompileProfile GetDefaultCompileProfile() { return s_defaultCompileProfile; }
+
+    // New shader with the same code and reflection data but its own uniform buffers, so the same compiled code
+    // can be used by another pipeline without going through Slang again
+    [[nodiscard]] std::shared_ptr<Shader> Clone() const;
 
 
 private:
     friend class Renderer;
     friend class Pipeline;
+    friend class ShaderVariants;
+
+    Shader() = default;
 
+    // called on the thread creating the pipeline, so uniform parameters can be set while it is still being created asynchronously
+    void CreateUniformBuffers();
     void Finalize(Pipeline* pipeline);
 
     struct Offset
@@ -128,8 +194,10 @@ private:
         uint32_t pushConstantRange = -1;
         uint32_t subelement        = -1;
     };
-    bool Compile(const std::filesystem::path& path, std::string_view entryPoint);
+    bool Compile(const std::filesystem::path& path, std::string_view entryPoint, const ShaderCompileOptions& options);
+    void CreateShaderModule();
     void Reflect(slang::ProgramLayout* layout);
+    void ReflectThreadGroupSize(const uint32_t* code, size_t wordCount);
 
     void GetLayout(slang::VariableLayoutReflection* vl, std::deque<slang::VariableLayoutReflection*>& pathStack, bool isEntryPoint);
 
@@ -151,10 +219,15 @@ private:
     }
 
 
+    static ShaderCompileProfile s_defaultCompileProfile;
+
     std::string m_name;
-    VkShaderModule m_shaderModule;
+    VkShaderModule m_shaderModule = VK_NULL_HANDLE;
     VkShaderStageFlagBits m_stage;
-    Pipeline* m_pipeline;
+    Pipeline* m_pipeline = nullptr;
+
+    // kept so Clone doesn't need to compile again, shared between the clones
+    std::shared_ptr<const std::vector<uint32_t>> m_spirv;
 
     struct Binding
     {
@@ -185,7 +258,9 @@ private:
     // shader, I can't think of a situtation that would result otherwise
     VkPushConstantRange m_pushConstantRange;
     std::vector<uint32_t> m_pushConstantSizes;
-    std::vector<uint8_t> m_pushConstantData;
+    // points into the pipeline's push constant data which every stage shares, assigned once the shader gets a pipeline and
+    // cleared again when that pipeline gets destroyed
+    std::span<uint8_t> m_pushConstantData;
 
     std::vector<Buffer> m_uniformBuffers;
     std::vector<std::tuple<uint32_t, uint32_t, uint64_t, uint64_t>> m_uniformBufferInfos;
@@ -194,6 +269,10 @@ private:
     uint32_t m_numThreadsX;
     uint32_t m_numThreadsY;
     uint32_t m_numThreadsZ;
+    // specialization constant id of every thread group axis that is one, the pipeline resolves the specialized value per pipeline
+    std::array<std::optional<uint32_t>, 3> m_threadGroupSizeIds;
+
+    std::unordered_map<std::string, uint32_t, string_hash, std::equal_to<>> m_specializationConstants;  // name -> constant id
 };
 
 // Bools in shaders are actually ints, so we have to make sure the extra 3 bytes don't contain garbage
@@ -230,6 +309,7 @@ void Shader::SetParameter(uint32_t frameIndex, std::string_view name, const T& d
 
     if(binding.isPushConstant)
     {
+        assert(!m_pushConstantData.empty() && "Push constants can only be set once the shader is part of a pipeline");
         std::memcpy(&m_pushConstantData[binding.offset], &data, binding.size);
     }
     else
@@ -254,6 +334,7 @@ void Shader::SetParameter(uint32_t frameIndex, std::string_view name, const std:
 
     if(binding.isPushConstant)
     {
+        assert(!m_pushConstantData.empty() && "Push constants can only be set once the shader is part of a pipeline");
         if(binding.stride != sizeof(T))
         {
             for(size_t i = 0; i < data.size(); i++)
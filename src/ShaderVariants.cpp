@@ -0,0 +1,148 @@
+#include "ShaderVariants.hpp"
+#include "Hash.hpp"
+#include "Log.hpp"
+#include <bit>
+#include <fstream>
+#include <sstream>
+
+ShaderVariants::ShaderVariants(const std::filesystem::path& path, VkShaderStageFlagBits stage, std::string_view entryPoint, std::vector<Keyword> keywords, std::filesystem::path cacheDirectory)
+    : m_path(path),
+      m_stage(stage),
+      m_entryPoint(entryPoint),
+      m_cacheDirectory(std::move(cacheDirectory))
+{
+    uint32_t shift = 0;
+    for(auto& keyword : keywords)
+    {
+        if(keyword.values.empty())
+        {
+            Log::Error("Keyword {} of shader {} has no values, ignoring it", keyword.name, m_path.string());
+            continue;
+        }
+        uint32_t bitCount = static_cast<uint32_t>(std::bit_width(keyword.values.size() - 1));
+        m_keywords.push_back({std::move(keyword), shift, bitCount});
+        shift += bitCount;
+    }
+    if(shift > sizeof(Key) * 8)
+    {
+        Log::Error("Shader {} has too many keyword combinations to fit in a {} bit key", m_path.string(), sizeof(Key) * 8);
+        abort();
+    }
+
+    // like PipelineManager only the file itself is hashed, editing an imported module doesn't invalidate the cache
+    std::ifstream file(m_path, std::ios::binary);
+    if(!file)
+        Log::Warn("Can't read shader {} to hash it", m_path.string());
+    std::stringstream content;
+    content << file.rdbuf();
+    m_sourceHash = HashFNV1a(content.str());
+    m_sourceHash = HashFNV1a(std::format("{}|{}", static_cast<uint32_t>(m_stage), m_entryPoint), m_sourceHash);
+}
+
+ShaderVariants::Key ShaderVariants::GetKey(std::initializer_list<std::pair<std::string_view, uint32_t>> values) const
+{
+    Key key = 0;
+    for(const auto& [name, valueIndex] : values)
+    {
+        uint32_t keywordIndex = GetKeywordIndex(name);
+        if(keywordIndex == m_keywords.size())
+        {
+            Log::Warn("Shader {} has no keyword named {}", m_path.string(), name);
+            continue;
+        }
+        key = SetKeyword(key, keywordIndex, valueIndex);
+    }
+    return key;
+}
+
+ShaderVariants::Key ShaderVariants::SetKeyword(Key key, uint32_t keywordIndex, uint32_t valueIndex) const
+{
+    const auto& slot = m_keywords[keywordIndex];
+    if(valueIndex >= slot.keyword.values.size())
+    {
+        Log::Error("Keyword {} of shader {} has no value {} (#values: {})", slot.keyword.name, m_path.string(), valueIndex, slot.keyword.values.size());
+        return key;
+    }
+    Key mask = ((Key(1) << slot.bitCount) - 1) << slot.shift;
+    return (key & ~mask) | (Key(valueIndex) << slot.shift);
+}
+
+uint32_t ShaderVariants::GetKeywordIndex(std::string_view name) const
+{
+    for(uint32_t i = 0; i < m_keywords.size(); i++)
+    {
+        if(m_keywords[i].keyword.name == name)
+            return i;
+    }
+    return static_cast<uint32_t>(m_keywords.size());
+}
+
+std::shared_ptr<Shader> ShaderVariants::Get(Key key)
+{
+    std::promise<std::shared_ptr<const Shader>> promise;
+    std::shared_future<std::shared_ptr<const Shader>> variant;
+    bool compile = false;
+    {
+        std::scoped_lock lock(m_mutex);
+        auto it = m_variants.find(key);
+        if(it == m_variants.end())
+        {
+            it      = m_variants.emplace(key, promise.get_future().share()).first;
+            compile = true;
+        }
+        variant = it->second;
+    }
+
+    // compiled without holding the lock so other variants can still be looked up, threads asking for this one wait on the future
+    if(compile)
+    {
+        try
+        {
+            promise.set_value(std::make_shared<Shader>(m_path, m_stage, m_entryPoint, CreateCompileOptions(key)));
+        }
+        catch(...)
+        {
+            // waiting threads get the exception too, the next Get of this key tries again
+            promise.set_exception(std::current_exception());
+            std::scoped_lock lock(m_mutex);
+            m_variants.erase(key);
+            throw;
+        }
+    }
+    return variant.get()->Clone();
+}
+
+size_t ShaderVariants::GetCompiledVariantCount() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_variants.size();
+}
+
+ShaderCompileOptions ShaderVariants::CreateCompileOptions(Key key) const
+{
+    ShaderCompileOptions options;
+    options.profile = Shader::GetDefaultCompileProfile();
+
+    std::string description = std::format("profile={};", static_cast<int>(*options.profile));
+    for(const auto& slot : m_keywords)
+    {
+        uint32_t valueIndex = static_cast<uint32_t>((key >> slot.shift) & ((Key(1) << slot.bitCount) - 1));
+        if(valueIndex >= slot.keyword.values.size())
+        {
+            Log::Error("Invalid value {} for keyword {} of shader {}, using the default", valueIndex, slot.keyword.name, m_path.string());
+            valueIndex = 0;
+        }
+
+        ShaderConstant constant{.name = slot.keyword.name, .value = slot.keyword.values[valueIndex], .type = slot.keyword.linkType};
+        description += std::format("{}|{}={}:{};", static_cast<int>(slot.keyword.kind), constant.name, constant.value, constant.type);
+        if(slot.keyword.kind == KeywordKind::DEFINE)
+            options.defines.push_back(std::move(constant));
+        else
+            options.linkConstants.push_back(std::move(constant));
+    }
+
+    // the whole description goes into the name rather than the key so changing the keyword list can't reuse a stale file
+    uint64_t hash          = HashFNV1a(description, m_sourceHash);
+    options.spirvCachePath = m_cacheDirectory / std::format("{}_{}_{:016x}.spv", m_path.stem().string(), m_entryPoint, hash);
+    return options;
+}
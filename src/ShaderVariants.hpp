@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Shader.hpp"
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Every combination of a shader's keywords (feature toggles, material types, ...) is its own variant. A variant gets compiled
+// the first time it's asked for, and kept in memory and in cacheDirectory so later runs skip code generation.
+// The selected value of every keyword is packed into a Key, so looking a variant up is a single hash map lookup:
+//      ShaderVariants variants("shaders/pbr.slang", VK_SHADER_STAGE_FRAGMENT_BIT, "main",
+//                              {{.name = "USE_NORMAL_MAP"}, {.name = "MATERIAL", .values = {"OPAQUE", "MASKED", "BLEND"}}});
+//      auto key = variants.GetKey({{"USE_NORMAL_MAP", 1}, {"MATERIAL", 2}});  // once, at load time
+//      auto shader = variants.Get(key);
+class ShaderVariants
+{
+public:
+    using Key = uint64_t;
+
+    enum class KeywordKind
+    {
+        DEFINE,         // #define NAME VALUE
+        LINK_CONSTANT,  // extern static const <linkType> NAME; gets VALUE at link time
+    };
+
+    struct Keyword
+    {
+        std::string name;
+        std::vector<std::string> values = {"0", "1"};  // index 0 is the default
+        KeywordKind kind                = KeywordKind::DEFINE;
+        std::string linkType            = "int";
+    };
+
+    ShaderVariants(const std::filesystem::path& path, VkShaderStageFlagBits stage, std::string_view entryPoint, std::vector<Keyword> keywords, std::filesystem::path cacheDirectory = "shader_cache");
+
+    ShaderVariants(const ShaderVariants& other)            = delete;
+    ShaderVariants& operator=(const ShaderVariants& other) = delete;
+
+    // value indices by keyword name, keywords that aren't listed keep their default. Meant to be called once up front, not per frame
+    [[nodiscard]] Key GetKey(std::initializer_list<std::pair<std::string_view, uint32_t>> values) const;
+    [[nodiscard]] Key SetKeyword(Key key, uint32_t keywordIndex, uint32_t valueIndex) const;
+    [[nodiscard]] uint32_t GetKeywordIndex(std::string_view name) const;
+
+    // returns a new Shader of the variant for a single pipeline, only the first call with a key compiles and every
+    // Shader returned for it shares that compiled code
+    std::shared_ptr<Shader> Get(Key key);
+
+    [[nodiscard]] size_t GetCompiledVariantCount() const;
+
+private:
+    struct KeywordSlot
+    {
+        Keyword keyword;
+        uint32_t shift;
+        uint32_t bitCount;
+    };
+
+    [[nodiscard]] ShaderCompileOptions CreateCompileOptions(Key key) const;
+
+    std::filesystem::path m_path;
+    VkShaderStageFlagBits m_stage;
+    std::string m_entryPoint;
+    std::filesystem::path m_cacheDirectory;
+    uint64_t m_sourceHash = 0;
+
+    std::vector<KeywordSlot> m_keywords;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<Key, std::shared_future<std::shared_ptr<const Shader>>> m_variants;  // compiled shader Get clones, not ready yet while the variant is compiling
+};
@@ -0,0 +1,25 @@
+#include "TextureCache.hpp"
+#include <algorithm>
+
+std::shared_ptr<Image> TextureCache::GetOrCreate(const TextureKey& key, const std::function<std::shared_ptr<Image>()>& create)
+{
+    // create happens under the lock, two loaders asking for the same image must not both create it
+    std::scoped_lock lock(m_mutex);
+
+    auto it = m_textures.find(key);
+    if(it != m_textures.end())
+    {
+        if(auto image = it->second.lock())
+            return image;
+    }
+    else if(m_textures.size() >= m_sweepThreshold)
+    {
+        // textures of unloaded models leave expired entries behind, drop them every time the map doubled
+        std::erase_if(m_textures, [](const auto& entry) { return entry.second.expired(); });
+        m_sweepThreshold = std::max<size_t>(64, m_textures.size() * 2);
+    }
+
+    auto image      = create();
+    m_textures[key] = image;
+    return image;
+}
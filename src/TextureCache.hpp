@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Image.hpp"
+#include "Sampler.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Identifies a texture by the bytes it was decoded from and how it ends up on the GPU. The sampler is part of it since the
+// image's bindless index is registered together with its sampler
+struct TextureKey
+{
+    std::string file;  // canonical path of the file the encoded image is in
+    uint64_t offset;
+    uint64_t size;
+    bool srgb;
+    SamplerConfig sampler;
+
+    bool operator==(const TextureKey& other) const = default;
+};
+
+namespace std
+{
+template<>
+struct hash<TextureKey>
+{
+    std::size_t operator()(const TextureKey& k) const
+    {
+        std::size_t result = 0;
+        hashCombine(result, k.file);
+        hashCombine(result, k.offset);
+        hashCombine(result, k.size);
+        hashCombine(result, k.srgb);
+        hashCombine(result, k.sampler);
+
+        return result;
+    }
+};
+}
+
+// Textures shared between everything that gets loaded, so models using the same image files only upload them once.
+// Only weak references are kept: an image is freed as soon as the last material using it is gone
+class TextureCache
+{
+public:
+    TextureCache() = default;
+
+    TextureCache(const TextureCache& other)            = delete;
+    TextureCache& operator=(const TextureCache& other) = delete;
+
+    // Returns the image for key if it's still alive, otherwise creates it with create and remembers it
+    std::shared_ptr<Image> GetOrCreate(const TextureKey& key, const std::function<std::shared_ptr<Image>()>& create);
+
+private:
+    std::mutex m_mutex;
+    std::unordered_map<TextureKey, std::weak_ptr<Image>> m_textures;
+    size_t m_sweepThreshold = 64;
+};
@@ -0,0 +1,195 @@
+#include "TextureStreamer.hpp"
+#include "Log.hpp"
+#include "ThreadPool.hpp"
+#include <array>
+#include <chrono>
+
+namespace
+{
+ImageCreateInfo PlaceholderCreateInfo()
+{
+    ImageCreateInfo ci{};
+    ci.format      = VK_FORMAT_R8G8B8A8_UNORM;
+    ci.usage       = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    ci.aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+    ci.layout      = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    ci.useMips     = false;
+    ci.debugName   = "texture placeholder";
+    return ci;
+}
+}
+
+// 2x2 because Image makes anything only one texel high a 1D image
+TextureStreamer::TextureStreamer() : m_placeholder(2, 2, PlaceholderCreateInfo())
+{
+    // white so it doesn't change the material factors it gets multiplied with
+    std::array<uint32_t, 4> pixels;
+    pixels.fill(0xffffffff);
+
+    Buffer staging(sizeof(pixels), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+    staging.Fill(pixels.data(), sizeof(pixels));
+    staging.CopyToImage(m_placeholder, 2, 2);
+    m_placeholder.TransitionLayout(VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    VkDevice device = VulkanContext::GetDevice();
+    for(auto& batch : m_inFlight)
+    {
+        vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        vkDestroyFence(device, batch.fence, nullptr);
+        for(auto& upload : batch.uploads)
+            upload.image->SetPlaceholder(nullptr);
+    }
+
+    // the placeholder goes away with the streamer, images that never got uploaded can't keep pointing at it
+    for(auto& decode : m_decoding)
+    {
+        if(decode.staging.valid())
+            decode.staging.wait();
+        decode.image->SetPlaceholder(nullptr);
+    }
+    for(auto& failed : m_failed)
+    {
+        if(auto image = failed.lock())
+            image->SetPlaceholder(nullptr);
+    }
+}
+
+std::shared_ptr<Image> TextureStreamer::Load(Request request)
+{
+    ImageCreateInfo ci{};
+    ci.format      = request.format;
+    ci.usage       = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    ci.aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+    ci.useMips     = request.mipOffsets.size() != 1;  // the full chain without mipOffsets
+    ci.mipLevels   = static_cast<uint32_t>(request.mipOffsets.size());
+    ci.debugName   = request.name;
+
+    auto image = std::make_shared<Image>(request.width, request.height, ci);
+    image->SetPlaceholder(&m_placeholder);
+    image->SetSamplerConfig(request.sampler);
+
+    const uint64_t size = request.mipOffsets.empty() ? static_cast<uint64_t>(request.width) * request.height * 4 : request.size;
+    auto task           = [size, decode = std::move(request.decode)]()
+    {
+        Buffer staging(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+        decode(static_cast<uint8_t*>(staging.GetMappedMemory()));
+        return staging;
+    };
+
+    Decode pending{image, std::move(request.name), std::move(request.mipOffsets), size, {}};
+    if(ThreadPool* threadPool = VulkanContext::GetThreadPool())
+    {
+        pending.staging = threadPool->Submit(std::move(task));
+    }
+    else
+    {
+        std::packaged_task<Buffer()> packagedTask(std::move(task));
+        pending.staging = packagedTask.get_future();
+        packagedTask();
+    }
+
+    std::scoped_lock lock(m_mutex);
+    m_decoding.push_back(std::move(pending));
+    return image;
+}
+
+void TextureStreamer::Update()
+{
+    VkDevice device = VulkanContext::GetDevice();
+
+    size_t finished = 0;
+    while(!m_inFlight.empty() && vkGetFenceStatus(device, m_inFlight.front().fence) == VK_SUCCESS)
+    {
+        Batch& batch = m_inFlight.front();
+        for(auto& upload : batch.uploads)
+            upload.image->SetPlaceholder(nullptr);
+        finished += batch.uploads.size();
+
+        vkDestroyFence(device, batch.fence, nullptr);
+        m_inFlight.pop_front();
+    }
+
+    std::vector<Decode> decoded;
+    {
+        std::scoped_lock lock(m_mutex);
+        m_uploadingCount -= finished;
+
+        // takes what finished decoding, up to the budget, and keeps the rest in order
+        uint64_t batchBytes = 0;
+        auto keep           = m_decoding.begin();
+        for(auto it = m_decoding.begin(); it != m_decoding.end(); ++it)
+        {
+            if(batchBytes < MAX_BATCH_BYTES && it->staging.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            {
+                batchBytes += it->size;
+                decoded.push_back(std::move(*it));
+            }
+            else
+            {
+                if(keep != it)
+                    *keep = std::move(*it);
+                ++keep;
+            }
+        }
+        m_decoding.erase(keep, m_decoding.end());
+    }
+
+    if(!decoded.empty())
+        SubmitBatch(decoded);
+}
+
+size_t TextureStreamer::GetPendingCount() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_decoding.size() + m_uploadingCount;
+}
+
+void TextureStreamer::SubmitBatch(std::vector<Decode>& decoded)
+{
+    Batch batch;
+    batch.commandBuffer.Begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    for(auto& decode : decoded)
+    {
+        Upload upload{std::move(decode.image), {}};
+        try
+        {
+            upload.staging = decode.staging.get();
+        }
+        catch(const std::exception& e)
+        {
+            Log::Error("Failed to decode texture {}: {}", decode.name, e.what());
+            m_failed.push_back(upload.image);
+            continue;
+        }
+
+        Image& image = *upload.image;
+        image.TransitionLayout(batch.commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        if(decode.mipOffsets.empty())
+        {
+            upload.staging.CopyToImage(batch.commandBuffer, image, image.GetWidth(), image.GetHeight());
+            image.GenerateMipmaps(batch.commandBuffer, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+        }
+        else
+        {
+            upload.staging.CopyToImageMips(batch.commandBuffer, image, decode.mipOffsets);
+            image.TransitionLayout(batch.commandBuffer, VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL);
+        }
+        batch.uploads.push_back(std::move(upload));
+    }
+    if(batch.uploads.empty())
+        return;
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VK_CHECK(vkCreateFence(VulkanContext::GetDevice(), &fenceInfo, nullptr, &batch.fence), "Failed to create fence");
+    batch.commandBuffer.Submit(VK_NULL_HANDLE, 0, VK_NULL_HANDLE, batch.fence);
+
+    {
+        std::scoped_lock lock(m_mutex);
+        m_uploadingCount += batch.uploads.size();
+    }
+    m_inFlight.push_back(std::move(batch));
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Buffer.hpp"
+#include "CommandBuffer.hpp"
+#include "Image.hpp"
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Gets textures onto the GPU without blocking the thread that loads them:
+//      auto image = streamer->Load({.width = w, .height = h, .format = VK_FORMAT_R8G8B8A8_SRGB, .sampler = s, .name = name, .decode = decode});
+// The image is created right away, but its sampled descriptor shows a white placeholder. decode runs on the thread pool and
+// writes the pixels straight into a staging buffer. Update, called by the renderer once per frame, records the uploads of
+// everything that finished decoding into one command buffer (copy of mip 0, mips blitted on the GPU, or a copy of every mip
+// for textures that come with theirs) and submits it with a fence, the bindless descriptors get switched to the real images once
+// that fence signaled. Descriptor sets aren't tracked, Image::IsReady tells when they have to be written again
+class TextureStreamer
+{
+public:
+    struct Request
+    {
+        uint32_t width;
+        uint32_t height;
+        VkFormat format;  // without mipOffsets 4 bytes per texel, it needs to support linear blits for the mips
+        SamplerConfig sampler;
+        std::string name;
+        // Where each mip starts in the staging memory, for textures that come with all their mips (e.g. block compressed
+        // ones). Empty means decode only writes mip 0 and the rest is generated
+        std::vector<uint64_t> mipOffsets;
+        uint64_t size = 0;  // staging bytes decode writes, only used with mipOffsets
+        // runs on a worker thread, writes width * height texels (or the mips) to dst. The memory may be write combined, so
+        // write it sequentially and don't read it
+        std::function<void(uint8_t* dst)> decode;
+    };
+
+    TextureStreamer();
+    ~TextureStreamer();
+
+    TextureStreamer(const TextureStreamer& other)            = delete;
+    TextureStreamer& operator=(const TextureStreamer& other) = delete;
+
+    // Can be called from any thread. If the decode throws the error is logged and the image keeps showing the placeholder
+    std::shared_ptr<Image> Load(Request request);
+
+    // called by the renderer once per frame
+    void Update();
+
+    // textures that were requested but can't be sampled yet
+    [[nodiscard]] size_t GetPendingCount() const;
+
+private:
+    struct Decode
+    {
+        std::shared_ptr<Image> image;
+        std::string name;
+        std::vector<uint64_t> mipOffsets;
+        uint64_t size;
+        std::future<Buffer> staging;
+    };
+    struct Upload
+    {
+        std::shared_ptr<Image> image;
+        Buffer staging;
+    };
+    struct Batch
+    {
+        CommandBuffer commandBuffer;
+        VkFence fence = VK_NULL_HANDLE;
+        std::vector<Upload> uploads;
+    };
+
+    void SubmitBatch(std::vector<Decode>& decoded);
+
+    // bounds the staging memory and the GPU time a single frame's batch takes
+    static constexpr uint64_t MAX_BATCH_BYTES = 64ull * 1024 * 1024;
+
+    Image m_placeholder;
+
+    mutable std::mutex m_mutex;
+    std::vector<Decode> m_decoding;
+    std::deque<Batch> m_inFlight;  // in submission order, so they also finish in that order, only used by the renderer's thread
+    size_t m_uploadingCount = 0;   // textures in m_inFlight
+    std::vector<std::weak_ptr<Image>> m_failed;
+};
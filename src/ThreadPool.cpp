@@ -0,0 +1,44 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    for(uint32_t i = 0; i < threadCount; i++)
+        m_workers.emplace_back([this](std::stop_token stopToken) { WorkerLoop(stopToken); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    for(auto& worker : m_workers)
+        worker.request_stop();
+    m_condition.notify_all();
+    m_workers.clear();
+}
+
+void ThreadPool::WaitIdle()
+{
+    std::unique_lock lock(m_mutex);
+    m_idleCondition.wait(lock, [this]() { return m_tasks.empty() && m_runningTasks == 0; });
+}
+
+void ThreadPool::WorkerLoop(std::stop_token stopToken)
+{
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(m_mutex);
+            // returns false once a stop got requested and there is nothing left to run
+            if(!m_condition.wait(lock, stopToken, [this]() { return !m_tasks.empty(); }))
+                return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            m_runningTasks++;
+        }
+        task();
+
+        std::scoped_lock lock(m_mutex);
+        m_runningTasks--;
+        if(m_tasks.empty() && m_runningTasks == 0)
+            m_idleCondition.notify_all();
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads running tasks in submission order.
+// Tasks that are still queued when the pool gets destroyed are run before the workers exit
+class ThreadPool
+{
+public:
+    ThreadPool(uint32_t threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool& other)            = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    template<typename F>
+    std::future<std::invoke_result_t<F>> Submit(F&& func)
+    {
+        // std::function has to be copyable, packaged_task isn't
+        auto task   = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(func));
+        auto future = task->get_future();
+        {
+            std::scoped_lock lock(m_mutex);
+            m_tasks.emplace_back([task]() { (*task)(); });
+        }
+        m_condition.notify_one();
+        return future;
+    }
+
+    // blocks until the queue is empty and no task is running anymore, including tasks submitted by other tasks
+    void WaitIdle();
+
+    [[nodiscard]] uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
+private:
+    void WorkerLoop(std::stop_token stopToken);
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_condition;
+    std::condition_variable m_idleCondition;
+    std::deque<std::function<void()>> m_tasks;
+    uint32_t m_runningTasks = 0;
+    std::vector<std::jthread> m_workers;  // last so they get joined before the queue goes away
+};
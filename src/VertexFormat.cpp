@@ -0,0 +1,146 @@
+#include "VertexFormat.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <glm/packing.hpp>
+
+namespace
+{
+struct CompactVertex
+{
+    int16_t position[4];
+    uint32_t normal;
+    uint32_t uv;
+};
+static_assert(sizeof(CompactVertex) == 16);
+
+int16_t QuantizeSnorm16(float value)
+{
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// Octahedral mapping (Meyer et al. 2010): the unit sphere is projected onto an octahedron which is unfolded into [-1, 1]^2.
+// A zero normal ends up at the center, which decodes to +Z
+glm::vec2 EncodeOctahedral(glm::vec3 n)
+{
+    const float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(sum == 0.0f)
+        return glm::vec2(0.0f);
+    n /= sum;
+
+    glm::vec2 p(n.x, n.y);
+    if(n.z < 0.0f)
+    {
+        p.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        p.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p;
+}
+
+constexpr const char* FULL_ACCESSOR_SOURCE = R"(
+public struct ModelVertex
+{{
+    public float3 position;
+    public float3 normal;
+    public float2 uv;
+}};
+
+public ModelVertex LoadModelVertex(ByteAddressBuffer vertices, uint vertexBufferOffset, uint index, float3 positionOffset, float3 positionScale)
+{{
+    uint address = vertexBufferOffset + index * {};
+
+    ModelVertex v;
+    v.position = positionOffset + positionScale * asfloat(vertices.Load3(address));
+    v.normal   = asfloat(vertices.Load3(address + 12));
+    v.uv       = asfloat(vertices.Load2(address + 24));
+    return v;
+}}
+)";
+
+constexpr const char* COMPACT_ACCESSOR_SOURCE = R"(
+public struct ModelVertex
+{{
+    public float3 position;
+    public float3 normal;
+    public float2 uv;
+}};
+
+int LowSnorm16(uint packed) {{ return int(packed << 16) >> 16; }}
+int HighSnorm16(uint packed) {{ return int(packed) >> 16; }}
+
+float3 DecodeOctahedral(float2 e)
+{{
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t  = saturate(-n.z);
+    n.x     += n.x >= 0.0 ? -t : t;
+    n.y     += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}}
+
+public ModelVertex LoadModelVertex(ByteAddressBuffer vertices, uint vertexBufferOffset, uint index, float3 positionOffset, float3 positionScale)
+{{
+    uint4 raw = vertices.Load4(vertexBufferOffset + index * {});
+
+    float3 position = float3(LowSnorm16(raw.x), HighSnorm16(raw.x), LowSnorm16(raw.y));
+    float2 normal   = float2(LowSnorm16(raw.z), HighSnorm16(raw.z));
+
+    ModelVertex v;
+    v.position = positionOffset + positionScale * max(position / 32767.0, -1.0);
+    v.normal   = DecodeOctahedral(max(normal / 32767.0, -1.0));
+    v.uv       = float2(f16tof32(raw.w & 0xffff), f16tof32(raw.w >> 16));
+    return v;
+}}
+)";
+}
+
+uint32_t GetVertexSize(VertexFormat format)
+{
+    switch(format)
+    {
+    case VertexFormat::COMPACT:
+        return sizeof(CompactVertex);
+    case VertexFormat::FULL:
+    default:
+        return (3 + 3 + 2) * sizeof(float);
+    }
+}
+
+PositionQuantization QuantizationFromBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    PositionQuantization quantization;
+    quantization.offset = (boundsMin + boundsMax) * 0.5f;
+    quantization.scale  = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(0.0f));
+    return quantization;
+}
+
+void CompressVertices(const uint8_t* src, size_t count, const PositionQuantization& quantization, uint8_t* dst)
+{
+    glm::vec3 inverseScale;
+    for(int axis = 0; axis < 3; ++axis)
+        inverseScale[axis] = quantization.scale[axis] > 0.0f ? 1.0f / quantization.scale[axis] : 0.0f;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        float full[8];
+        std::memcpy(full, src + i * GetVertexSize(VertexFormat::FULL), sizeof(full));
+
+        const glm::vec3 position = (glm::vec3(full[0], full[1], full[2]) - quantization.offset) * inverseScale;
+
+        CompactVertex compact;
+        compact.position[0] = QuantizeSnorm16(position.x);
+        compact.position[1] = QuantizeSnorm16(position.y);
+        compact.position[2] = QuantizeSnorm16(position.z);
+        compact.position[3] = 0;
+        compact.normal      = glm::packSnorm2x16(EncodeOctahedral(glm::vec3(full[3], full[4], full[5])));
+        compact.uv          = glm::packHalf2x16(glm::vec2(full[6], full[7]));
+        std::memcpy(dst + i * sizeof(CompactVertex), &compact, sizeof(compact));
+    }
+}
+
+std::string GenerateVertexAccessor(VertexFormat format)
+{
+    if(format == VertexFormat::COMPACT)
+        return std::format(COMPACT_ACCESSOR_SOURCE, GetVertexSize(format));
+    return std::format(FULL_ACCESSOR_SOURCE, GetVertexSize(format));
+}
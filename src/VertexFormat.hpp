@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+
+// Layouts Model can store its vertices in
+enum class VertexFormat : uint32_t
+{
+    FULL,     // float3 position, float3 normal, float2 uv: 32 bytes
+    COMPACT,  // snorm16x4 position relative to the mesh bounds (w unused), octahedral snorm16x2 normal, half2 uv: 16 bytes
+};
+
+uint32_t GetVertexSize(VertexFormat format);
+
+// object space position = offset + scale * stored position. Identity for VertexFormat::FULL
+struct PositionQuantization
+{
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale  = glm::vec3(1.0f);
+};
+
+// Maps the box between boundsMin and boundsMax to [-1, 1], flat axes get a scale of 0
+PositionQuantization QuantizationFromBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+// Writes count VertexFormat::FULL vertices from src to dst in VertexFormat::COMPACT. src and dst may be the same, each
+// vertex is read before its compact version (which is half the size) gets written
+void CompressVertices(const uint8_t* src, size_t count, const PositionQuantization& quantization, uint8_t* dst);
+
+// Source of a Slang module (VERTEX_ACCESSOR_MODULE) to import in shaders that read vertices of format from a buffer. The model's
+// vertex buffer is in the bindless heap, read through a read-only view of the heap's buffer binding:
+//      import model_vertex;
+//      [[vk::binding(2, 3)]] ByteAddressBuffer vertexBuffers[];
+//      ModelVertex v = LoadModelVertex(vertexBuffers[vertexBuffer], primitive.vertexBufferOffset, index, mesh.offset, mesh.scale);
+// It always returns float values, whatever the format. Add it with ShaderCompileOptions::modules
+std::string GenerateVertexAccessor(VertexFormat format);
+
+inline constexpr const char* VERTEX_ACCESSOR_MODULE = "model_vertex";
@@ -6,9 +6,18 @@
 #include "Log.hpp"
 
 #define NUM_FRAMES_IN_FLIGHT 2
-static constexpr uint32_t NUM_DESCRIPTORS = 10000;
 
 class Pipeline;
+class BindlessHeap;
+class DescriptorAllocator;
+class DescriptorLayoutCache;
+class PipelineCache;
+class ThreadPool;
+class PipelineManager;
+class DescriptorBuffer;
+class IndirectDispatch;
+class TextureCache;
+class TextureStreamer;
 class VulkanContext
 {
 public:
@@ -19,7 +28,15 @@ public:
     static VkQueue GetQueue() { return m_queue; }
     static uint32_t GetQueueIndex() { return m_queueIndex; }
     static VkCommandPool GetCommandPool() { return m_commandPool; }
-    static VkDescriptorPool GetDescriptorPool() { return m_descriptorPool; }
+    static VkDescriptorPool GetDescriptorPool() { return m_descriptorPool; }  // ImGui only
+    static DescriptorAllocator* GetDescriptorAllocator() { return m_descriptorAllocator; }
+    static DescriptorLayoutCache* GetDescriptorLayoutCache() { return m_descriptorLayoutCache; }
+    static VkPipelineCache GetPipelineCache() { return m_pipelineCache; }
+    static ThreadPool* GetThreadPool() { return m_threadPool; }
+    static PipelineManager* GetPipelineManager() { return m_pipelineManager; }
+    static IndirectDispatch* GetIndirectDispatch() { return m_indirectDispatch; }
+    static TextureCache* GetTextureCache() { return m_textureCache; }
+    static TextureStreamer* GetTextureStreamer() { return m_textureStreamer; }
     static VkFormat GetSwapchainImageFormat() { return m_swapchainImageFormat; }
     static VkFormat GetDepthFormat() { return m_depthFormat; }
     static VkFormat GetStencilFormat() { return m_stencilFormat; }
@@ -31,6 +48,12 @@ public:
 
     static VmaAllocator GetVmaAllocator() { return m_vmaAllocator; }
 
+    static BindlessHeap* GetBindlessHeap() { return m_bindlessHeap; }
+    // nullptr if VK_EXT_descriptor_buffer isn't supported
+    static DescriptorBuffer* GetDescriptorBuffer() { return m_descriptorBuffer; }
+    // whether VK_KHR_push_descriptor is enabled, PipelineCreateInfo::pushDescriptorSet is ignored without it
+    static bool SupportsPushDescriptors() { return m_supportsPushDescriptors; }
+
     static VkViewport GetViewport(uint32_t width, uint32_t height)
     {
         VkViewport viewport = {};
@@ -62,8 +85,16 @@ private:
     inline static VkQueue m_queue = {};
     inline static uint32_t m_queueIndex;
 
-    inline static VkCommandPool m_commandPool       = VK_NULL_HANDLE;
-    inline static VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    inline static VkCommandPool m_commandPool                    = VK_NULL_HANDLE;
+    inline static VkDescriptorPool m_descriptorPool              = VK_NULL_HANDLE;
+    inline static DescriptorAllocator* m_descriptorAllocator     = nullptr;
+    inline static DescriptorLayoutCache* m_descriptorLayoutCache = nullptr;
+    inline static VkPipelineCache m_pipelineCache                = VK_NULL_HANDLE;
+    inline static ThreadPool* m_threadPool                       = nullptr;
+    inline static PipelineManager* m_pipelineManager             = nullptr;
+    inline static IndirectDispatch* m_indirectDispatch           = nullptr;
+    inline static TextureCache* m_textureCache                   = nullptr;
+    inline static TextureStreamer* m_textureStreamer             = nullptr;
 
     inline static VkDebugUtilsMessengerEXT m_messenger = VK_NULL_HANDLE;
 
@@ -77,6 +108,10 @@ private:
     inline static VkSampler m_textureSampler = VK_NULL_HANDLE;
 
     inline static VmaAllocator m_vmaAllocator = VK_NULL_HANDLE;
+
+    inline static BindlessHeap* m_bindlessHeap         = nullptr;
+    inline static DescriptorBuffer* m_descriptorBuffer = nullptr;
+    inline static bool m_supportsPushDescriptors       = false;
 };
 
 